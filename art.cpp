@@ -0,0 +1,543 @@
+#include "art.h"
+
+#include <cstring>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct ART::Node {
+  enum class Type : std::uint8_t { Leaf, Node4, Node16, Node48, Node256 };
+
+  Type type;
+
+  explicit Node(Type t) : type(t) { }
+};
+
+struct ART::Leaf : Node {
+  std::uint32_t key;
+  itemType item;
+
+  Leaf(std::uint32_t k, itemType i) : Node(Type::Leaf), key(k), item(std::move(i)) { }
+};
+
+// A key is at most 4 bytes and an inner node branches on at least one of
+// them, so a compressed prefix never needs more than 3
+struct ART::Inner : Node {
+  std::uint16_t count = 0;
+  std::uint8_t prefixLength = 0;
+  std::uint8_t prefix[3] = {};
+
+  explicit Inner(Type t) : Node(t) { }
+};
+
+// Node4 and Node16 keep their key bytes sorted
+struct ART::Node4 : Inner {
+  std::uint8_t keys[4] = {};
+  Node* children[4] = {};
+
+  Node4() : Inner(Type::Node4) { }
+};
+
+struct ART::Node16 : Inner {
+  std::uint8_t keys[16] = {};
+  Node* children[16] = {};
+
+  Node16() : Inner(Type::Node16) { }
+};
+
+// childIndex holds slot + 1 for each key byte present, 0 otherwise
+struct ART::Node48 : Inner {
+  std::uint8_t childIndex[256] = {};
+  Node* children[48] = {};
+
+  Node48() : Inner(Type::Node48) { }
+};
+
+struct ART::Node256 : Inner {
+  Node* children[256] = {};
+
+  Node256() : Inner(Type::Node256) { }
+};
+
+// Flipping the sign bit makes unsigned byte order match signed key order
+std::uint32_t ART::radixKey(keyType k) {
+  return static_cast<std::uint32_t>(k) ^ 0x80000000u;
+}
+
+// Byte of the key at the given depth, most significant first
+std::uint8_t ART::keyByte(std::uint32_t key, unsigned depth) {
+  return static_cast<std::uint8_t>(key >> (24 - 8 * depth));
+}
+
+// Number of prefix bytes matching the key from depth onwards
+unsigned ART::prefixMismatch(Inner* n, std::uint32_t key, unsigned depth) {
+  unsigned i = 0;
+  while (i < n->prefixLength && n->prefix[i] == keyByte(key, depth + i)) ++i;
+  return i;
+}
+
+ART::itemType* ART::lookup(keyType k) {
+  std::uint32_t key = radixKey(k);
+  Node* currentNode = _root;
+  unsigned depth = 0;
+
+  while (currentNode != nullptr) {
+    if (currentNode->type == Node::Type::Leaf) {
+      Leaf* leaf = static_cast<Leaf*>(currentNode);
+      return leaf->key == key ? &(leaf->item) : nullptr;
+    }
+
+    Inner* inner = static_cast<Inner*>(currentNode);
+    if (prefixMismatch(inner, key, depth) != inner->prefixLength) return nullptr;
+    depth += inner->prefixLength;
+
+    Node** child = findChild(inner, keyByte(key, depth));
+    if (child == nullptr) return nullptr;
+
+    currentNode = *child;
+    ++depth;
+  }
+
+  return nullptr;
+}
+
+ART::Node** ART::findChild(Inner* n, std::uint8_t b) {
+  switch (n->type) {
+    case Node::Type::Node4: {
+      Node4* node = static_cast<Node4*>(n);
+      for (unsigned i = 0; i < node->count; ++i)
+        if (node->keys[i] == b) return &(node->children[i]);
+      return nullptr;
+    }
+
+    case Node::Type::Node16: {
+      Node16* node = static_cast<Node16*>(n);
+#ifdef __SSE2__
+      // Compares all 16 key bytes at once
+      __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(b)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(node->keys)));
+      unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches)) & ((1u << node->count) - 1);
+      return mask != 0 ? &(node->children[__builtin_ctz(mask)]) : nullptr;
+#else
+      for (unsigned i = 0; i < node->count; ++i)
+        if (node->keys[i] == b) return &(node->children[i]);
+      return nullptr;
+#endif
+    }
+
+    case Node::Type::Node48: {
+      Node48* node = static_cast<Node48*>(n);
+      return node->childIndex[b] != 0 ? &(node->children[node->childIndex[b] - 1]) : nullptr;
+    }
+
+    case Node::Type::Node256: {
+      Node256* node = static_cast<Node256*>(n);
+      return node->children[b] != nullptr ? &(node->children[b]) : nullptr;
+    }
+
+    default:
+      return nullptr;
+  }
+}
+
+// Inserts into a sorted key array of a Node4 or Node16 with room to spare
+template <typename SmallNode, typename Child>
+static void addSorted(SmallNode* node, std::uint8_t b, Child* child) {
+  unsigned position = 0;
+  while (position < node->count && node->keys[position] < b) ++position;
+
+  for (unsigned i = node->count; i > position; --i) {
+    node->keys[i] = node->keys[i - 1];
+    node->children[i] = node->children[i - 1];
+  }
+
+  node->keys[position] = b;
+  node->children[position] = child;
+  ++node->count;
+}
+
+// Copies the count and compressed prefix from one inner node to another
+template <typename To, typename From>
+static void copyHeader(To* to, const From* from) {
+  to->count = from->count;
+  to->prefixLength = from->prefixLength;
+  std::memcpy(to->prefix, from->prefix, sizeof(from->prefix));
+}
+
+// Adds a child to the inner node in n, growing it first if it is full
+void ART::addChild(Node*& n, std::uint8_t b, Node* child) {
+  switch (n->type) {
+    case Node::Type::Node4: {
+      Node4* node = static_cast<Node4*>(n);
+      if (node->count < 4) {
+        addSorted(node, b, child);
+        return;
+      }
+
+      Node16* bigger = new Node16();
+      copyHeader(bigger, node);
+      std::memcpy(bigger->keys, node->keys, sizeof(node->keys));
+      std::memcpy(bigger->children, node->children, sizeof(node->children));
+      delete node;
+      n = bigger;
+      addSorted(bigger, b, child);
+      return;
+    }
+
+    case Node::Type::Node16: {
+      Node16* node = static_cast<Node16*>(n);
+      if (node->count < 16) {
+        addSorted(node, b, child);
+        return;
+      }
+
+      Node48* bigger = new Node48();
+      copyHeader(bigger, node);
+      for (unsigned i = 0; i < 16; ++i) {
+        bigger->childIndex[node->keys[i]] = static_cast<std::uint8_t>(i + 1);
+        bigger->children[i] = node->children[i];
+      }
+      delete node;
+      n = bigger;
+      addChild(n, b, child);
+      return;
+    }
+
+    case Node::Type::Node48: {
+      Node48* node = static_cast<Node48*>(n);
+      if (node->count < 48) {
+        unsigned slot = 0;
+        while (node->children[slot] != nullptr) ++slot;
+        node->children[slot] = child;
+        node->childIndex[b] = static_cast<std::uint8_t>(slot + 1);
+        ++node->count;
+        return;
+      }
+
+      Node256* bigger = new Node256();
+      copyHeader(bigger, node);
+      for (unsigned k = 0; k < 256; ++k)
+        if (node->childIndex[k] != 0)
+          bigger->children[k] = node->children[node->childIndex[k] - 1];
+      delete node;
+      n = bigger;
+      addChild(n, b, child);
+      return;
+    }
+
+    case Node::Type::Node256: {
+      Node256* node = static_cast<Node256*>(n);
+      node->children[b] = child;
+      ++node->count;
+      return;
+    }
+
+    default:
+      return;
+  }
+}
+
+// Removes a child from the inner node in n, shrinking it when it falls
+// well below capacity. A Node4 left with one child is replaced by that
+// child, whose prefix absorbs the node's prefix and key byte.
+void ART::removeChild(Node*& n, std::uint8_t b) {
+  switch (n->type) {
+    case Node::Type::Node4: {
+      Node4* node = static_cast<Node4*>(n);
+      unsigned position = 0;
+      while (node->keys[position] != b) ++position;
+
+      for (unsigned i = position + 1; i < node->count; ++i) {
+        node->keys[i - 1] = node->keys[i];
+        node->children[i - 1] = node->children[i];
+      }
+      --node->count;
+
+      if (node->count == 1) {
+        Node* only = node->children[0];
+
+        if (only->type != Node::Type::Leaf) {
+          Inner* child = static_cast<Inner*>(only);
+          std::uint8_t merged[3];
+          unsigned length = 0;
+
+          for (unsigned i = 0; i < node->prefixLength; ++i) merged[length++] = node->prefix[i];
+          merged[length++] = node->keys[0];
+          for (unsigned i = 0; i < child->prefixLength; ++i) merged[length++] = child->prefix[i];
+
+          std::memcpy(child->prefix, merged, length);
+          child->prefixLength = static_cast<std::uint8_t>(length);
+        }
+
+        delete node;
+        n = only;
+      }
+      return;
+    }
+
+    case Node::Type::Node16: {
+      Node16* node = static_cast<Node16*>(n);
+      unsigned position = 0;
+      while (node->keys[position] != b) ++position;
+
+      for (unsigned i = position + 1; i < node->count; ++i) {
+        node->keys[i - 1] = node->keys[i];
+        node->children[i - 1] = node->children[i];
+      }
+      --node->count;
+
+      if (node->count == 3) {
+        Node4* smaller = new Node4();
+        copyHeader(smaller, node);
+        std::memcpy(smaller->keys, node->keys, 3);
+        std::memcpy(smaller->children, node->children, 3 * sizeof(Node*));
+        delete node;
+        n = smaller;
+      }
+      return;
+    }
+
+    case Node::Type::Node48: {
+      Node48* node = static_cast<Node48*>(n);
+      node->children[node->childIndex[b] - 1] = nullptr;
+      node->childIndex[b] = 0;
+      --node->count;
+
+      if (node->count == 12) {
+        Node16* smaller = new Node16();
+        copyHeader(smaller, node);
+        unsigned i = 0;
+        for (unsigned k = 0; k < 256; ++k) {
+          if (node->childIndex[k] == 0) continue;
+          smaller->keys[i] = static_cast<std::uint8_t>(k);
+          smaller->children[i++] = node->children[node->childIndex[k] - 1];
+        }
+        delete node;
+        n = smaller;
+      }
+      return;
+    }
+
+    case Node::Type::Node256: {
+      Node256* node = static_cast<Node256*>(n);
+      node->children[b] = nullptr;
+      --node->count;
+
+      if (node->count == 37) {
+        Node48* smaller = new Node48();
+        copyHeader(smaller, node);
+        unsigned slot = 0;
+        for (unsigned k = 0; k < 256; ++k) {
+          if (node->children[k] == nullptr) continue;
+          smaller->children[slot] = node->children[k];
+          smaller->childIndex[k] = static_cast<std::uint8_t>(++slot);
+        }
+        delete node;
+        n = smaller;
+      }
+      return;
+    }
+
+    default:
+      return;
+  }
+}
+
+void ART::insert(keyType k, itemType i) {
+  insertRec(_root, radixKey(k), i, 0);
+}
+
+void ART::insertRec(Node*& currentNode, std::uint32_t key, itemType& i, unsigned depth) {
+  if (currentNode == nullptr) {
+    currentNode = new Leaf(key, std::move(i));
+    return;
+  }
+
+  // Replace a leaf holding another key with a branch between the two
+  if (currentNode->type == Node::Type::Leaf) {
+    Leaf* leaf = static_cast<Leaf*>(currentNode);
+    if (leaf->key == key) {
+      leaf->item = std::move(i);
+      return;
+    }
+
+    Node4* branch = new Node4();
+    while (keyByte(leaf->key, depth) == keyByte(key, depth))
+      branch->prefix[branch->prefixLength++] = keyByte(key, depth++);
+
+    Node* n = branch;
+    addChild(n, keyByte(leaf->key, depth), leaf);
+    addChild(n, keyByte(key, depth), new Leaf(key, std::move(i)));
+    currentNode = n;
+    return;
+  }
+
+  // Split a compressed prefix that the key leaves part way through
+  Inner* inner = static_cast<Inner*>(currentNode);
+  unsigned matched = prefixMismatch(inner, key, depth);
+
+  if (matched < inner->prefixLength) {
+    Node4* branch = new Node4();
+    branch->prefixLength = static_cast<std::uint8_t>(matched);
+    std::memcpy(branch->prefix, inner->prefix, matched);
+
+    Node* n = branch;
+    addChild(n, inner->prefix[matched], inner);
+    addChild(n, keyByte(key, depth + matched), new Leaf(key, std::move(i)));
+
+    inner->prefixLength = static_cast<std::uint8_t>(inner->prefixLength - matched - 1);
+    std::memmove(inner->prefix, inner->prefix + matched + 1, inner->prefixLength);
+
+    currentNode = n;
+    return;
+  }
+
+  depth += inner->prefixLength;
+  Node** child = findChild(inner, keyByte(key, depth));
+
+  if (child != nullptr)
+    insertRec(*child, key, i, depth + 1);
+  else
+    addChild(currentNode, keyByte(key, depth), new Leaf(key, std::move(i)));
+}
+
+void ART::remove(keyType k) {
+  removeRec(_root, radixKey(k), 0);
+}
+
+void ART::removeRec(Node*& currentNode, std::uint32_t key, unsigned depth) {
+  if (currentNode == nullptr) return;
+
+  // Only reached for a lone leaf at the root
+  if (currentNode->type == Node::Type::Leaf) {
+    Leaf* leaf = static_cast<Leaf*>(currentNode);
+    if (leaf->key == key) {
+      delete leaf;
+      currentNode = nullptr;
+    }
+    return;
+  }
+
+  Inner* inner = static_cast<Inner*>(currentNode);
+  if (prefixMismatch(inner, key, depth) != inner->prefixLength) return;
+  depth += inner->prefixLength;
+
+  std::uint8_t b = keyByte(key, depth);
+  Node** child = findChild(inner, b);
+  if (child == nullptr) return;
+
+  if ((*child)->type != Node::Type::Leaf) {
+    removeRec(*child, key, depth + 1);
+    return;
+  }
+
+  Leaf* leaf = static_cast<Leaf*>(*child);
+  if (leaf->key != key) return;
+
+  delete leaf;
+  removeChild(currentNode, b);
+}
+
+ART::~ART() { deepDelete(_root); }
+
+void ART::deepDelete(Node* currentNode) {
+  if (currentNode == nullptr) return;
+
+  switch (currentNode->type) {
+    case Node::Type::Leaf:
+      delete static_cast<Leaf*>(currentNode);
+      return;
+
+    case Node::Type::Node4: {
+      Node4* node = static_cast<Node4*>(currentNode);
+      for (unsigned i = 0; i < node->count; ++i) deepDelete(node->children[i]);
+      delete node;
+      return;
+    }
+
+    case Node::Type::Node16: {
+      Node16* node = static_cast<Node16*>(currentNode);
+      for (unsigned i = 0; i < node->count; ++i) deepDelete(node->children[i]);
+      delete node;
+      return;
+    }
+
+    case Node::Type::Node48: {
+      Node48* node = static_cast<Node48*>(currentNode);
+      for (Node* child : node->children) deepDelete(child);
+      delete node;
+      return;
+    }
+
+    case Node::Type::Node256: {
+      Node256* node = static_cast<Node256*>(currentNode);
+      for (Node* child : node->children) deepDelete(child);
+      delete node;
+      return;
+    }
+  }
+}
+
+ART::Node* ART::deepCopy(Node* source) {
+  if (source == nullptr) return nullptr;
+
+  switch (source->type) {
+    case Node::Type::Leaf:
+      return new Leaf(*static_cast<Leaf*>(source));
+
+    case Node::Type::Node4: {
+      Node4* result = new Node4(*static_cast<Node4*>(source));
+      for (unsigned i = 0; i < result->count; ++i) result->children[i] = deepCopy(result->children[i]);
+      return result;
+    }
+
+    case Node::Type::Node16: {
+      Node16* result = new Node16(*static_cast<Node16*>(source));
+      for (unsigned i = 0; i < result->count; ++i) result->children[i] = deepCopy(result->children[i]);
+      return result;
+    }
+
+    case Node::Type::Node48: {
+      Node48* result = new Node48(*static_cast<Node48*>(source));
+      for (Node*& child : result->children) child = deepCopy(child);
+      return result;
+    }
+
+    case Node::Type::Node256: {
+      Node256* result = new Node256(*static_cast<Node256*>(source));
+      for (Node*& child : result->children) child = deepCopy(child);
+      return result;
+    }
+  }
+
+  return nullptr;
+}
+
+ART::ART(const ART& artToCopy) {
+  this->_root = deepCopy(artToCopy._root);
+}
+
+ART& ART::operator = (const ART& artToCopy) {
+  if (this != &artToCopy) {
+    deepDelete(this->_root);
+    this->_root = deepCopy(artToCopy._root);
+  }
+  return *this;
+}
+
+ART::ART(ART&& artToMove) {
+  this->_root = artToMove._root;
+  artToMove._root = nullptr;
+}
+
+ART& ART::operator = (ART&& rhs) {
+  if (this != &rhs) {
+    deepDelete(this->_root);
+    this->_root = rhs._root;
+    rhs._root = nullptr;
+  }
+
+  return *this;
+}
@@ -0,0 +1,54 @@
+#ifndef ART_H
+#define ART_H
+
+#include <cstdint>
+#include <string>
+
+// Adaptive radix tree over the bytes of an int key, with the same
+// dictionary semantics as BST. Inner nodes grow and shrink between 4, 16,
+// 48 and 256 children, and single-child paths are compressed into prefixes.
+class ART {
+  public:
+    using keyType = int;
+    using itemType = std::string;
+
+    ART() = default;
+    ~ART();
+
+    ART(const ART&);
+    ART& operator = (const ART&);
+
+    ART(ART&&);
+    ART& operator = (ART&&);
+
+    itemType* lookup(keyType);
+    void insert(keyType, itemType);
+    void remove(keyType);
+
+  private:
+    struct Node;
+    struct Leaf;
+    struct Inner;
+    struct Node4;
+    struct Node16;
+    struct Node48;
+    struct Node256;
+
+    Node* _root = nullptr;
+
+    void insertRec(Node*&, std::uint32_t, itemType&, unsigned);
+    void removeRec(Node*&, std::uint32_t, unsigned);
+
+    static std::uint32_t radixKey(keyType);
+    static std::uint8_t keyByte(std::uint32_t, unsigned);
+
+    static Node** findChild(Inner*, std::uint8_t);
+    static void addChild(Node*&, std::uint8_t, Node*);
+    static void removeChild(Node*&, std::uint8_t);
+    static unsigned prefixMismatch(Inner*, std::uint32_t, unsigned);
+
+    static void deepDelete(Node*);
+    static Node* deepCopy(Node*);
+};
+
+#endif
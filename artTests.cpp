@@ -0,0 +1,265 @@
+#include "art.h"
+
+// NOTE: Required before the include below
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE art_tests
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <random>
+
+using Dict = ART;
+using keyType = Dict::keyType;
+using itemType = Dict::itemType;
+
+// Utility functions
+
+void isPresent(Dict& dict, keyType k, itemType i) {
+  itemType* p_i = dict.lookup(k);
+
+  BOOST_CHECK_MESSAGE(p_i, std::to_string(k) + " is missing");
+
+  if (p_i) {
+    BOOST_CHECK_MESSAGE(*p_i == i,
+      std::to_string(k) + " should be " + i + ", but found " + *p_i);
+  }
+}
+
+void isAbsent(Dict& dict, keyType k) {
+  BOOST_CHECK_MESSAGE(dict.lookup(k) == nullptr,
+    std::to_string(k) + " should be absent, but is present");
+}
+
+void insertTestData(Dict& dict) {
+  dict.insert(9, "Edward");
+  dict.insert(22, "Jane");
+  dict.insert(22, "Mary");
+  dict.insert(0, "Harold");
+  dict.insert(37, "Victoria");
+  dict.insert(4, "Matilda");
+  dict.insert(26, "Oliver");
+  dict.insert(42, "Elizabeth");
+  dict.insert(19, "Henry");
+  dict.insert(4, "Stephen");
+  dict.insert(24, "James");
+  dict.insert(-1, "Edward");
+  dict.insert(31, "Anne");
+  dict.insert(23, "Elizabeth");
+  dict.insert(1, "William");
+  dict.insert(26, "Charles");
+}
+
+void checkTestData(Dict& dict) {
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( lookup_insert_tests )
+
+BOOST_AUTO_TEST_CASE( empty_lookup ) {
+  Dict dict;
+  isAbsent(dict, 1);
+}
+
+BOOST_AUTO_TEST_CASE( single_overwrite_lookup ) {
+  Dict dict;
+
+  dict.insert(22, "Jane");
+  dict.insert(22, "Mary");
+
+  isPresent(dict, 22, "Mary");
+  isAbsent(dict, 23);
+}
+
+BOOST_AUTO_TEST_CASE( multiple_insert_lookup ) {
+  Dict dict;
+  insertTestData(dict);
+
+  checkTestData(dict);
+  isAbsent(dict, 2);
+  isAbsent(dict, 25);
+  isAbsent(dict, -2);
+}
+
+BOOST_AUTO_TEST_CASE( extreme_keys ) {
+  Dict dict;
+
+  dict.insert(INT32_MIN, "min");
+  dict.insert(INT32_MAX, "max");
+  dict.insert(0, "zero");
+  dict.insert(-1, "minus one");
+  dict.insert(256, "256");
+
+  isPresent(dict, INT32_MIN, "min");
+  isPresent(dict, INT32_MAX, "max");
+  isPresent(dict, 0, "zero");
+  isPresent(dict, -1, "minus one");
+  isPresent(dict, 256, "256");
+  isAbsent(dict, 1);
+  isAbsent(dict, 65536);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( remove_tests )
+
+BOOST_AUTO_TEST_CASE( empty_remove ) {
+  Dict dict;
+
+  dict.remove(43);
+  isAbsent(dict, 43);
+}
+
+BOOST_AUTO_TEST_CASE( remove_only_entry ) {
+  Dict dict;
+
+  dict.insert(7, "John");
+  dict.remove(8);
+  isPresent(dict, 7, "John");
+
+  dict.remove(7);
+  isAbsent(dict, 7);
+}
+
+BOOST_AUTO_TEST_CASE( insert_many_remove ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.remove(0);
+  dict.remove(37);
+  dict.remove(22);
+  dict.remove(6);
+
+  isAbsent(dict, 0);
+  isAbsent(dict, 37);
+  isAbsent(dict, 22);
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( remove_collapses_prefixes ) {
+  Dict dict;
+
+  dict.insert(0x01020304, "a");
+  dict.insert(0x01020305, "b");
+  dict.insert(0x01030000, "c");
+  dict.insert(0x02000000, "d");
+
+  dict.remove(0x02000000);
+  dict.remove(0x01030000);
+
+  isPresent(dict, 0x01020304, "a");
+  isPresent(dict, 0x01020305, "b");
+
+  dict.insert(0x01020400, "e");
+  dict.remove(0x01020304);
+
+  isPresent(dict, 0x01020305, "b");
+  isPresent(dict, 0x01020400, "e");
+  isAbsent(dict, 0x01020304);
+}
+
+// Grows and shrinks every node size against std::map as a reference
+BOOST_AUTO_TEST_CASE( random_against_map ) {
+  Dict dict;
+  std::map<keyType, itemType> expected;
+  std::mt19937 rng(7);
+
+  for (keyType range : {300, 5000, 1 << 30}) {
+    std::uniform_int_distribution<keyType> key(-range, range);
+
+    for (int step = 0; step < 20000; ++step) {
+      keyType k = key(rng);
+      if (rng() % 3 == 0) {
+        dict.remove(k);
+        expected.erase(k);
+      } else {
+        dict.insert(k, std::to_string(step));
+        expected[k] = std::to_string(step);
+      }
+    }
+
+    for (keyType probe = -400; probe <= 400; ++probe) {
+      auto found = expected.find(probe);
+      if (found == expected.end()) isAbsent(dict, probe);
+      else isPresent(dict, probe, found->second);
+    }
+
+    for (auto& entry : expected)
+      isPresent(dict, entry.first, entry.second);
+  }
+
+  for (auto& entry : expected)
+    dict.remove(entry.first);
+  isAbsent(dict, expected.begin()->first);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( copy_move_tests )
+
+BOOST_AUTO_TEST_CASE( copy_constructor_is_deep ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+
+  Dict dict_2(dict_1);
+  checkTestData(dict_2);
+
+  dict_1.insert(2, "William");
+  dict_2.remove(26);
+
+  isAbsent(dict_2, 2);
+  isPresent(dict_1, 26, "Charles");
+}
+
+BOOST_AUTO_TEST_CASE( copy_assignment_overwrites ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+
+  Dict dict_2;
+  dict_2.insert(2, "William");
+
+  dict_1 = dict_2;
+  dict_2 = dict_2;
+
+  isAbsent(dict_1, 4);
+  isPresent(dict_1, 2, "William");
+  isPresent(dict_2, 2, "William");
+}
+
+BOOST_AUTO_TEST_CASE( move_steals ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+
+  Dict dict_2(std::move(dict_1));
+  isAbsent(dict_1, 22);
+  checkTestData(dict_2);
+
+  Dict dict_3;
+  dict_3.insert(2, "William");
+  dict_3 = std::move(dict_2);
+
+  isAbsent(dict_3, 2);
+  checkTestData(dict_3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,31 +1,229 @@
 #include "bst.h"
+#include "stringPool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+// Each node is either an OwnedNode holding its item or, while the tree
+// interns values, a smaller PooledNode sharing one through the pool
 struct BST::Node {
   keyType key;
-  itemType item;
+  bool pooled;
 
   Node* leftChild;
   Node* rightChild;
 
-  Node(keyType k, itemType i) 
-    : key(k), item(i), leftChild(nullptr), rightChild(nullptr) { } 
+  // Block holding this node if it was placed by compaction, else nullptr
+  Arena* arena;
+
+  // Neighbours in the tree's recency list
+  Node* moreRecent;
+  Node* lessRecent;
+
+  Node(keyType k, bool p) 
+    : key(k), pooled(p), leftChild(nullptr), rightChild(nullptr),
+      arena(nullptr), moreRecent(nullptr), lessRecent(nullptr) { } 
+
+  const itemType& value() const;
+  std::size_t counted() const;
+  void recount();
+  std::size_t footprint() const;
+};
+
+struct BST::OwnedNode : Node {
+  itemType item;
+
+  // Item size when the tree last counted it; the item can be resized
+  // through lookup without the tree seeing it
+  std::size_t countedBytes;
+
+  OwnedNode(keyType k, itemType i) : Node(k, false), item(std::move(i)), countedBytes(item.size()) { }
+};
+
+// The pooled item never changes in place, so it needs no separate count
+struct BST::PooledNode : Node {
+  const itemType* shared;
+
+  PooledNode(keyType k, const itemType* s) : Node(k, true), shared(s) { }
+};
+
+const BST::itemType& BST::Node::value() const {
+  return pooled ? *static_cast<const PooledNode*>(this)->shared
+                : static_cast<const OwnedNode*>(this)->item;
+}
+
+std::size_t BST::Node::counted() const {
+  return pooled ? static_cast<const PooledNode*>(this)->shared->size()
+                : static_cast<const OwnedNode*>(this)->countedBytes;
+}
+
+void BST::Node::recount() {
+  if (!pooled) static_cast<OwnedNode*>(this)->countedBytes = value().size();
+}
+
+std::size_t BST::Node::footprint() const {
+  return pooled ? sizeof(PooledNode) : sizeof(OwnedNode);
+}
+
+// Contiguous storage for nodes relocated by compaction. It is freed once
+// every node placed in it has been destroyed and compaction has let go of it.
+struct BST::Arena {
+  char* block;
+  std::size_t capacity; // Bytes
+  std::size_t used = 0;
+  std::atomic<std::size_t> references{1}; // Nodes may be destroyed in parallel
 };
 
+struct BST::Compaction {
+  enum class Phase { Measure, Flatten, Balance, Relayout };
+
+  Phase phase = Phase::Measure;
+  std::vector<std::pair<Node*, std::size_t>> unmeasured; // With their depths
+  std::size_t depthsBefore = 0;
+  std::size_t depthsAfter = 0;
+  Node** cursor;
+  std::size_t size = 0;
+  std::size_t remaining = 0;
+  std::size_t rotationsLeft = 0;
+  std::size_t bytes = 0; // Of the nodes counted so far
+  std::deque<keyType> pending; // Keys rather than slots, so writes cannot invalidate them
+  Arena* arena = nullptr;
+  CompactionStats stats;
+
+  explicit Compaction(Node** root) : cursor(root) {
+    if (!isLeaf(*root)) unmeasured.emplace_back(*root, 1);
+  }
+};
+
+// Read-optimised snapshot of the tree's keys in sorted order. Each segment
+// is a linear model that predicts a key's position to within maxError, so a
+// lookup is a search over the few segments and then a short bounded search.
+struct BST::LearnedIndex {
+  struct Segment {
+    keyType firstKey;
+    std::size_t firstPosition;
+    double slope;
+  };
+
+  std::vector<keyType> keys;
+  std::vector<Node*> nodes; // nullptr once the entry has left the tree
+  std::vector<Segment> segments;
+  std::size_t maxError;
+
+  explicit LearnedIndex(std::size_t e) : maxError(e) { }
+
+  void train();
+  Node** find(keyType);
+};
+
+// Greedily extends each segment while some slope keeps every key in it
+// within maxError of its true position
+void BST::LearnedIndex::train() {
+  const double error = static_cast<double>(maxError);
+  std::size_t first = 0;
+
+  while (first < keys.size()) {
+    double lowSlope = 0.0;
+    double highSlope = HUGE_VAL;
+    std::size_t next = first + 1;
+
+    for (; next < keys.size(); ++next) {
+      double dx = static_cast<double>(keys[next]) - keys[first];
+      double dy = static_cast<double>(next - first);
+      double low = std::max(lowSlope, (dy - error) / dx);
+      double high = std::min(highSlope, (dy + error) / dx);
+      if (low > high) break;
+      lowSlope = low;
+      highSlope = high;
+    }
+
+    double slope = next == first + 1 ? 0.0 : (lowSlope + highSlope) / 2;
+    segments.push_back({keys[first], first, slope});
+    first = next;
+  }
+}
+
+BST::Node** BST::LearnedIndex::find(keyType soughtKey) {
+  auto segment = std::upper_bound(segments.begin(), segments.end(), soughtKey,
+    [](keyType k, const Segment& s) { return k < s.firstKey; });
+  if (segment == segments.begin()) return nullptr;
+  --segment;
+
+  double predicted = segment->firstPosition
+    + segment->slope * (static_cast<double>(soughtKey) - segment->firstKey);
+  double low = std::max(0.0, std::floor(predicted) - maxError);
+  double high = std::min(static_cast<double>(keys.size()), std::ceil(predicted) + maxError + 1);
+  if (low >= high) return nullptr;
+
+  auto begin = keys.begin() + static_cast<std::ptrdiff_t>(low);
+  auto end = keys.begin() + static_cast<std::ptrdiff_t>(high);
+  auto found = std::lower_bound(begin, end, soughtKey);
+  if (found == end || *found != soughtKey) return nullptr;
+
+  return &nodes[static_cast<std::size_t>(found - keys.begin())];
+}
+
 BST::Node* BST::leaf() { return nullptr; } 
 
 bool BST::isLeaf(Node* n) { return n == nullptr; }
 
 BST::itemType* BST::lookup(keyType soughtKey) {
-  return lookupRec(soughtKey, _root);
+  Node* found = findNode(soughtKey);
+  if (isLeaf(found)) return nullptr;
+
+  // The caller may change the item, so an entry sharing it takes a copy
+  if (found->pooled) found = unshare(found);
+  return &static_cast<OwnedNode*>(found)->item;
 }
 
-BST::itemType* BST::lookupRec(keyType soughtKey, Node* currentNode) {
-  if (isLeaf(currentNode)) return nullptr;
+const BST::itemType* BST::view(keyType soughtKey) {
+  Node* found = findNode(soughtKey);
+  return isLeaf(found) ? nullptr : &found->value();
+}
+
+BST::Node* BST::findNode(keyType soughtKey) {
+  // Keys inserted since the index was built are only found in the tree
+  Node* found = leaf();
+  if (_index != nullptr) {
+    Node** indexed = _index->find(soughtKey);
+    if (indexed != nullptr) found = *indexed;
+  }
+
+  if (isLeaf(found)) found = lookupRec(soughtKey, _root);
+  if (isLeaf(found)) return leaf();
+
+  // Only a bounded tree needs reads to refresh recency
+  if (bounded()) touch(found);
+  return found;
+}
+
+// Replaces a node sharing its item with one holding its own copy
+BST::Node* BST::unshare(Node* n) {
+  settleCompaction();
+  _finger.clear();
+
+  Node** slot = &_root;
+  while (*slot != n)
+    slot = n->key < (*slot)->key ? &(*slot)->leftChild : &(*slot)->rightChild;
+
+  replaceNode(*slot, new OwnedNode(n->key, n->value()), _pool.get());
+  return *slot;
+}
+
+BST::Node* BST::lookupRec(keyType soughtKey, Node* currentNode) {
+  if (isLeaf(currentNode)) return leaf();
 
   if (soughtKey == currentNode->key)
-    return &(currentNode->item);
+    return currentNode;
 
   return soughtKey < currentNode->key 
     ? lookupRec(soughtKey, currentNode->leftChild)
@@ -33,14 +231,22 @@ BST::itemType* BST::lookupRec(keyType soughtKey, Node* currentNode) {
 }
 
 void BST::insert(keyType k, itemType i) {
-  insertRec(k, i, _root);
+  settleCompaction();
+
+  if (_fingerSearch)
+    insertFromFinger(k, i);
+  else
+    insertRec(k, i, _root);
+
+  while (overCapacity() && evict()) { }
 }
 
 void BST::insertRec(keyType k, itemType i, Node*& currentNode) {
   if (isLeaf(currentNode)) {
-    currentNode = new Node(k, i);
+    currentNode = makeNode(k, i);
+    track(currentNode);
   } else if (k == currentNode->key) {
-    currentNode->item = i;
+    overwrite(currentNode, i);
   } else if (k < currentNode->key) {
     insertRec(k, i, currentNode->leftChild);
   } else {
@@ -48,6 +254,66 @@ void BST::insertRec(keyType k, itemType i, Node*& currentNode) {
   }
 }
 
+// A node that stopped sharing its item through lookup shares the new one
+void BST::overwrite(Node*& currentNode, itemType i) {
+  if (_pool && !currentNode->pooled) {
+    replaceNode(currentNode, makeNode(currentNode->key, std::move(i)), nullptr);
+  } else {
+    _cache.payloadBytes -= currentNode->counted();
+
+    if (currentNode->pooled) {
+      PooledNode* n = static_cast<PooledNode*>(currentNode);
+      const itemType* previous = n->shared;
+      n->shared = _pool->acquire(i);
+      _pool->release(previous);
+    } else {
+      static_cast<OwnedNode*>(currentNode)->item = std::move(i);
+    }
+
+    currentNode->recount();
+    _cache.payloadBytes += currentNode->counted();
+  }
+
+  touch(currentNode);
+}
+
+void BST::setFingerSearch(bool enabled) {
+  _fingerSearch = enabled;
+  _finger.clear();
+}
+
+// Climbs the remembered path until k falls inside a subtree's key interval,
+// then descends from there, extending the path to the new insertion point
+void BST::insertFromFinger(keyType k, itemType i) {
+  auto covers = [k](const FingerStep& step) {
+    return (!step.hasLow || step.low < k) && (!step.hasHigh || k < step.high);
+  };
+
+  while (!_finger.empty() && !covers(_finger.back()))
+    _finger.pop_back();
+
+  if (_finger.empty())
+    _finger.push_back({&_root, 0, 0, false, false});
+
+  while (true) {
+    FingerStep step = _finger.back();
+    Node*& currentNode = *step.slot;
+
+    if (isLeaf(currentNode)) {
+      currentNode = makeNode(k, i);
+      track(currentNode);
+      return;
+    } else if (k == currentNode->key) {
+      overwrite(currentNode, i);
+      return;
+    } else if (k < currentNode->key) {
+      _finger.push_back({&currentNode->leftChild, step.low, currentNode->key, step.hasLow, true});
+    } else {
+      _finger.push_back({&currentNode->rightChild, currentNode->key, step.high, true, step.hasHigh});
+    }
+  }
+}
+
 void BST::displayEntries() {
   displayEntriesRec(_root);
 }
@@ -57,7 +323,7 @@ void BST::displayEntriesRec(Node* currentNode) {
 
   // In-order traversal
   displayEntriesRec(currentNode->leftChild);
-  std::cout << currentNode->key << " " << currentNode->item << std::endl;
+  std::cout << currentNode->key << " " << currentNode->value() << std::endl;
   displayEntriesRec(currentNode->rightChild);
 }
 
@@ -80,64 +346,280 @@ void BST::displayTreeRec(const std::string& prefix, Node* currentNode, bool isLe
   }
 }
 
-BST::~BST() { deepDelete(_root); }
+BST::~BST() {
+  abandonCompaction();
+  dropIndex();
+  deepDelete(_root, forkLevels());
+}
 
-void BST::deepDelete(Node* currentNode) {
+// Frees the left subtree on another thread while forks remain
+void BST::deepDelete(Node* currentNode, unsigned forks) {
   if (isLeaf(currentNode)) return;
 
-  deepDelete(currentNode->leftChild);
-  deepDelete(currentNode->rightChild);
-  delete currentNode;
+  if (forks > 0) {
+    auto left = std::async(std::launch::async,
+      [this, currentNode, forks] { deepDelete(currentNode->leftChild, forks - 1); });
+    deepDelete(currentNode->rightChild, forks - 1);
+    left.get();
+  } else {
+    deepDelete(currentNode->leftChild);
+    deepDelete(currentNode->rightChild);
+  }
+
+  disposeNode(currentNode);
 }
 
-BST::Node* BST::minimumNode(Node* currentNode) {
-  while (!isLeaf(currentNode->leftChild))
-    currentNode = currentNode->leftChild;
-  return currentNode;
+// Unlinks the smallest node of a non-empty subtree and returns it
+BST::Node* BST::detachMinimum(Node*& currentNode) {
+  if (isLeaf(currentNode->leftChild)) {
+    Node* minimum = currentNode;
+    currentNode = currentNode->rightChild;
+    minimum->rightChild = leaf();
+    return minimum;
+  }
+
+  return detachMinimum(currentNode->leftChild);
 }
 
-void BST::remove(keyType k) { removeRec(k, _root); }
+void BST::destroyNode(Node* n) {
+  if (isLeaf(n)) return;
 
-void BST::removeRec(keyType k, Node*& currentNode) {
-  if (isLeaf(currentNode)) return;
+  Arena* arena = n->arena;
+  if (n->pooled) {
+    PooledNode* p = static_cast<PooledNode*>(n);
+    if (arena == nullptr) delete p;
+    else p->~PooledNode();
+  } else {
+    OwnedNode* o = static_cast<OwnedNode*>(n);
+    if (arena == nullptr) delete o;
+    else o->~OwnedNode();
+  }
+
+  if (arena != nullptr) releaseArena(arena);
+}
+
+void BST::releaseArena(Arena* arena) {
+  if (--arena->references > 0) return;
+
+  ::operator delete(arena->block);
+  delete arena;
+}
+
+void BST::remove(keyType k) {
+  settleCompaction();
+  _finger.clear();
+  reindex(k, leaf());
+
+  Node* found = detachRec(k, _root);
+  if (!isLeaf(found)) untrack(found);
+  disposeNode(found);
+}
+
+// Unlinks the node holding k and returns it childless, or nullptr if absent
+BST::Node* BST::detachRec(keyType k, Node*& currentNode) {
+  if (isLeaf(currentNode)) return nullptr;
 
   else if (k < currentNode->key) {
-    removeRec(k, currentNode->leftChild);
+    return detachRec(k, currentNode->leftChild);
   }
 
   else if (k > currentNode->key) {
-    removeRec(k, currentNode->rightChild);
+    return detachRec(k, currentNode->rightChild);
   }
 
-  // Found node to delete
+  // Found node to detach
+  Node* found = currentNode;
+
+  // Case 1: Node has no children
+  if (isLeaf(currentNode->leftChild) && isLeaf(currentNode->rightChild)) {
+    currentNode = leaf();
+  }
+
+  // Case 2: Node has one child
+  else if (isLeaf(currentNode->leftChild)) {
+    currentNode = currentNode->rightChild; // Moves root
+  } else if (isLeaf(currentNode->rightChild)) {
+    currentNode = currentNode->leftChild;
+  }
+
+  // Case 3: Node has two children - the successor node takes its place
   else {
-    // Case 1: Node has no children
-    if (isLeaf(currentNode->leftChild) && isLeaf(currentNode->rightChild)) {
-      delete currentNode;
-      currentNode = leaf();
-    }
-    
-    // Case 2: Node has one child
-    else if (isLeaf(currentNode->leftChild)) {
-      Node* temp = currentNode;
-      currentNode = currentNode->rightChild; // Moves root
-      delete temp;
-    } else if (isLeaf(currentNode->rightChild)) {
-      Node* temp = currentNode;
-      currentNode = currentNode->leftChild;
-      delete temp;
-    } 
-    
-    // Case 3: Node has two children
-    else {
-      Node* temp = minimumNode(currentNode->rightChild);
-      currentNode->key = temp->key;
-      currentNode->item = temp->item;
-      removeRec(temp->key, currentNode->rightChild);
-    }
+    Node* successor = detachMinimum(currentNode->rightChild);
+    successor->leftChild = currentNode->leftChild;
+    successor->rightChild = currentNode->rightChild;
+    currentNode = successor;
+  }
+
+  found->leftChild = leaf();
+  found->rightChild = leaf();
+  return found;
+}
+
+// Removes every key in [low, high]. Subtrees lying wholly inside the range
+// are cut away and freed in one sweep rather than removed key by key.
+void BST::removeRange(keyType low, keyType high) {
+  if (high < low) return;
+
+  settleCompaction();
+  _finger.clear();
+  removeRangeRec(low, high, _root);
+}
+
+void BST::removeRangeRec(keyType low, keyType high, Node*& currentNode) {
+  if (isLeaf(currentNode)) return;
+
+  if (currentNode->key < low) {
+    removeRangeRec(low, high, currentNode->rightChild);
+  } else if (currentNode->key > high) {
+    removeRangeRec(low, high, currentNode->leftChild);
+  } else {
+    // What survives on the left is below the range and on the right above it
+    Node* left = keepBelow(low, currentNode->leftChild);
+    Node* right = keepAbove(high, currentNode->rightChild);
+
+    currentNode->leftChild = leaf();
+    currentNode->rightChild = leaf();
+    discardSubtree(currentNode);
+    currentNode = join(left, right);
+  }
+}
+
+// Returns what is left of a subtree after discarding its keys >= low
+BST::Node* BST::keepBelow(keyType low, Node* currentNode) {
+  if (isLeaf(currentNode)) return leaf();
+
+  if (currentNode->key < low) {
+    currentNode->rightChild = keepBelow(low, currentNode->rightChild);
+    return currentNode;
+  }
+
+  // This node and its whole right subtree are in the range
+  Node* left = currentNode->leftChild;
+  currentNode->leftChild = leaf();
+  discardSubtree(currentNode);
+  return keepBelow(low, left);
+}
+
+// Returns what is left of a subtree after discarding its keys <= high
+BST::Node* BST::keepAbove(keyType high, Node* currentNode) {
+  if (isLeaf(currentNode)) return leaf();
+
+  if (currentNode->key > high) {
+    currentNode->leftChild = keepAbove(high, currentNode->leftChild);
+    return currentNode;
+  }
+
+  Node* right = currentNode->rightChild;
+  currentNode->rightChild = leaf();
+  discardSubtree(currentNode);
+  return keepAbove(high, right);
+}
+
+// Joins two trees where every key in left is below every key in right
+BST::Node* BST::join(Node* left, Node* right) {
+  if (isLeaf(left)) return right;
+  if (isLeaf(right)) return left;
+
+  Node* successor = detachMinimum(right);
+  successor->leftChild = left;
+  successor->rightChild = right;
+  return successor;
+}
+
+// Frees a detached subtree, keeping the index and recency list in step
+void BST::discardSubtree(Node* currentNode) {
+  if (isLeaf(currentNode)) return;
+
+  discardSubtree(currentNode->leftChild);
+  discardSubtree(currentNode->rightChild);
+
+  reindex(currentNode->key, leaf());
+  untrack(currentNode);
+  disposeNode(currentNode);
+}
+
+BST::NodeHandle BST::extract(keyType k) {
+  settleCompaction();
+  _finger.clear();
+  reindex(k, leaf());
+
+  Node* found = detachRec(k, _root);
+  if (isLeaf(found)) return NodeHandle();
+
+  // Handles always own their item, so they can move between pools
+  untrack(found);
+  if (found->pooled) {
+    Node* owned = new OwnedNode(found->key, found->value());
+    disposeNode(found);
+    found = owned;
+  }
+
+  return NodeHandle(found);
+}
+
+void BST::insert(NodeHandle&& handle) {
+  if (handle.empty()) return;
+
+  settleCompaction();
+  _finger.clear();
+
+  Node* n = handle._node;
+  handle._node = nullptr;
+  if (_pool) {
+    Node* shared = makeNode(n->key, std::move(static_cast<OwnedNode*>(n)->item));
+    destroyNode(n);
+    n = shared;
+  }
+
+  insertNodeRec(n, _root);
+  while (overCapacity() && evict()) { }
+}
+
+void BST::insertNodeRec(Node* n, Node*& currentNode) {
+  if (isLeaf(currentNode)) {
+    currentNode = n;
+    track(n);
+  } else if (n->key == currentNode->key) {
+    // Overwrite by relinking the new node in place of the old one
+    n->leftChild = currentNode->leftChild;
+    n->rightChild = currentNode->rightChild;
+    untrack(currentNode);
+    track(n);
+    disposeNode(currentNode);
+    currentNode = n;
+    reindex(n->key, n);
+  } else if (n->key < currentNode->key) {
+    insertNodeRec(n, currentNode->leftChild);
+  } else {
+    insertNodeRec(n, currentNode->rightChild);
   }
 }
 
+BST::NodeHandle::NodeHandle(Node* n) : _node(n) { }
+
+BST::NodeHandle::~NodeHandle() { destroyNode(_node); }
+
+BST::NodeHandle::NodeHandle(NodeHandle&& handleToMove) {
+  this->_node = handleToMove._node;
+  handleToMove._node = nullptr;
+}
+
+BST::NodeHandle& BST::NodeHandle::operator = (NodeHandle&& rhs) {
+  if (this != &rhs) {
+    destroyNode(this->_node);
+    this->_node = rhs._node;
+    rhs._node = nullptr;
+  }
+
+  return *this;
+}
+
+bool BST::NodeHandle::empty() const { return isLeaf(_node); }
+
+BST::keyType BST::NodeHandle::key() const { return _node->key; }
+
+BST::itemType& BST::NodeHandle::item() const { return static_cast<OwnedNode*>(_node)->item; }
+
 // Shallow copy
 // BST::BST(const BST& bstToCopy) {
 //   this->root = bstToCopy.root;
@@ -145,15 +627,34 @@ void BST::removeRec(keyType k, Node*& currentNode) {
 
 // Deep copy construction
 BST::BST(const BST& bstToCopy) {
-  this->_root = deepCopy(bstToCopy._root);
+  copyFrom(bstToCopy);
 }
 
-BST::Node* BST::deepCopy(Node* source) {
+// Copies the left subtree on another thread while forks remain
+BST::Node* BST::deepCopy(Node* source, unsigned forks) {
   if (isLeaf(source)) return nullptr;
 
-  Node* result = new Node(source->key, source->item);
-  result->leftChild = deepCopy(source->leftChild);
-  result->rightChild = deepCopy(source->rightChild);
+  Node* result;
+  if (source->pooled) {
+    const itemType* shared = static_cast<PooledNode*>(source)->shared;
+    _pool->retain(shared);
+    result = new PooledNode(source->key, shared);
+  } else {
+    OwnedNode* owned = new OwnedNode(source->key, source->value());
+    owned->countedBytes = static_cast<OwnedNode*>(source)->countedBytes;
+    result = owned;
+  }
+
+  if (forks > 0) {
+    auto left = std::async(std::launch::async,
+      [this, source, forks] { return deepCopy(source->leftChild, forks - 1); });
+    result->rightChild = deepCopy(source->rightChild, forks - 1);
+    result->leftChild = left.get();
+  } else {
+    result->leftChild = deepCopy(source->leftChild);
+    result->rightChild = deepCopy(source->rightChild);
+  }
+
   return result;
 }
 
@@ -167,21 +668,625 @@ BST::Node* BST::deepCopy(Node* source) {
 
 // Deep copy assignment
 BST& BST::operator = (const BST& bstToCopy) {
-  if (this != &bstToCopy)
-    this->_root = deepCopy(bstToCopy._root);
+  if (this != &bstToCopy) {
+    abandonCompaction();
+    dropIndex();
+    deepDelete(this->_root, forkLevels());
+    copyFrom(bstToCopy);
+  }
   return *this;
 }
 
 BST::BST(BST&& bstToMove) {
-  this->_root = bstToMove._root;
-  bstToMove._root = nullptr;
+  bstToMove.abandonCompaction();
+  stealFrom(bstToMove);
 }
 
 BST& BST::operator = (BST&& rhs) {
-  if (this != &rhs) {    
-    this->_root = rhs._root;
-    rhs._root = nullptr;
+  if (this != &rhs) {
+    abandonCompaction();
+    rhs.abandonCompaction();
+    dropIndex();
+    deepDelete(this->_root, forkLevels());
+    stealFrom(rhs);
   }
 
   return *this;
 }
+
+// Copies the entries and capacity limits; the copy starts with the same
+// recency order but no eviction history. Copies keep the source's byte
+// counts, so the totals carry over unchanged.
+void BST::copyFrom(const BST& source) {
+  this->_fingerSearch = source._fingerSearch;
+  this->_finger.clear();
+  this->_pool = source._pool;
+  this->_parallelism = source._parallelism;
+  this->_root = deepCopy(source._root, source.forkLevels());
+  this->_mostRecent = leaf();
+  this->_leastRecent = leaf();
+  this->_maxEntries = source._maxEntries;
+  this->_maxPayloadBytes = source._maxPayloadBytes;
+  this->_cache = CacheStats();
+  this->_cache.entries = source._cache.entries;
+  this->_cache.payloadBytes = source._cache.payloadBytes;
+
+  if (!bounded()) return;
+
+  // Pairs each source node with its copy, then links the copies from
+  // least to most recently used
+  std::unordered_map<Node*, Node*> copies(source._cache.entries);
+  pairCopiesRec(source._root, this->_root, copies);
+
+  for (Node* n = source._leastRecent; !isLeaf(n); n = n->moreRecent)
+    link(copies[n]);
+}
+
+void BST::pairCopiesRec(Node* source, Node* copy, std::unordered_map<Node*, Node*>& copies) {
+  if (isLeaf(source)) return;
+
+  copies.emplace(source, copy);
+  pairCopiesRec(source->leftChild, copy->leftChild, copies);
+  pairCopiesRec(source->rightChild, copy->rightChild, copies);
+}
+
+void BST::stealFrom(BST& source) {
+  this->_fingerSearch = source._fingerSearch;
+  this->_finger.clear();
+  source._finger.clear();
+  this->_root = source._root;
+  source._root = nullptr;
+  this->_index = source._index;
+  source._index = nullptr;
+  this->_mostRecent = source._mostRecent;
+  this->_leastRecent = source._leastRecent;
+  source._mostRecent = leaf();
+  source._leastRecent = leaf();
+  this->_maxEntries = source._maxEntries;
+  this->_maxPayloadBytes = source._maxPayloadBytes;
+  this->_cache = source._cache;
+  source._cache = CacheStats();
+  this->_pool = std::move(source._pool);
+  this->_parallelism = source._parallelism;
+}
+
+// Compaction measures the tree's depths, rebalances with Day-Stout-Warren
+// and then moves every node, in breadth-first order, into one contiguous
+// block. The work is split into small steps so it can be spread across
+// calls to compactStep. A write in between first finishes any measuring and
+// rotations still to do, so the tree is never left as a vine; relocation
+// finds each node by key and carries on around the write. Entries added
+// meanwhile may stay outside the block.
+
+BST::CompactionStats BST::compact() {
+  abandonCompaction();
+  while (!compactStep(1024)) { }
+  return _lastCompaction;
+}
+
+// Performs at most budget steps, starting a new compaction if none is in
+// progress. Returns true once the compaction has finished.
+bool BST::compactStep(std::size_t budget) {
+  _finger.clear();
+  if (_compaction == nullptr)
+    _compaction = new Compaction(&_root);
+
+  for (; budget > 0; --budget) {
+    switch (_compaction->phase) {
+      case Compaction::Phase::Measure: measureStep(); break;
+      case Compaction::Phase::Flatten: flattenStep(); break;
+      case Compaction::Phase::Balance: balanceStep(); break;
+      case Compaction::Phase::Relayout: relayoutStep(); break;
+    }
+
+    if (_compaction->phase == Compaction::Phase::Relayout && _compaction->pending.empty()) {
+      Compaction& c = *_compaction;
+      if (c.size > 0)
+        c.stats.averageDepthBefore = static_cast<double>(c.depthsBefore) / c.size;
+      if (c.stats.nodesRelocated > 0)
+        c.stats.averageDepth = static_cast<double>(c.depthsAfter) / c.stats.nodesRelocated;
+
+      _lastCompaction = c.stats;
+      abandonCompaction();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const BST::CompactionStats& BST::lastCompaction() const { return _lastCompaction; }
+
+// Finishes the measuring and rotations of a compaction in progress, which
+// writes could not follow, leaving only relocation to do
+void BST::settleCompaction() {
+  if (_compaction == nullptr) return;
+
+  while (_compaction->phase == Compaction::Phase::Measure) measureStep();
+  while (_compaction->phase == Compaction::Phase::Flatten) flattenStep();
+  while (_compaction->phase == Compaction::Phase::Balance) balanceStep();
+}
+
+// Gives up a compaction in progress once the tree is balanced again
+void BST::abandonCompaction() {
+  if (_compaction == nullptr) return;
+
+  settleCompaction();
+  if (_compaction->arena != nullptr)
+    releaseArena(_compaction->arena);
+  delete _compaction;
+  _compaction = nullptr;
+}
+
+// Records the depth of one node of the tree as it was, for comparison with
+// the compacted layout
+void BST::measureStep() {
+  Compaction& c = *_compaction;
+  if (c.unmeasured.empty()) {
+    c.phase = Compaction::Phase::Flatten;
+    return;
+  }
+
+  Node* n = c.unmeasured.back().first;
+  std::size_t depth = c.unmeasured.back().second;
+  c.unmeasured.pop_back();
+
+  c.depthsBefore += depth;
+  if (depth > c.stats.heightBefore) c.stats.heightBefore = depth;
+
+  if (!isLeaf(n->leftChild)) c.unmeasured.emplace_back(n->leftChild, depth + 1);
+  if (!isLeaf(n->rightChild)) c.unmeasured.emplace_back(n->rightChild, depth + 1);
+}
+
+// Rotates the tree into a right-leaning vine, one rotation or move per step
+void BST::flattenStep() {
+  Compaction& c = *_compaction;
+  Node* rest = *c.cursor;
+
+  if (!isLeaf(rest) && !isLeaf(rest->leftChild)) {
+    Node* left = rest->leftChild;
+    rest->leftChild = left->rightChild;
+    left->rightChild = rest;
+    *c.cursor = left;
+  } else if (!isLeaf(rest)) {
+    c.cursor = &rest->rightChild;
+    ++c.size;
+    c.bytes += rest->footprint();
+  } else {
+    // The first pass only rotates the nodes that fill the bottom level
+    std::size_t fullLevels = 1;
+    while (fullLevels <= c.size + 1) fullLevels *= 2;
+    fullLevels /= 2;
+
+    c.rotationsLeft = c.size + 1 - fullLevels;
+    c.remaining = c.size - c.rotationsLeft;
+    c.cursor = &_root;
+    c.phase = Compaction::Phase::Balance;
+  }
+}
+
+// Compresses the vine into a balanced tree, one left rotation per step
+void BST::balanceStep() {
+  Compaction& c = *_compaction;
+
+  if (c.rotationsLeft > 0) {
+    Node* child = *c.cursor;
+    Node* up = child->rightChild;
+    *c.cursor = up;
+    child->rightChild = up->leftChild;
+    up->leftChild = child;
+    c.cursor = &up->rightChild;
+    --c.rotationsLeft;
+  } else if (c.remaining > 1) {
+    c.remaining /= 2;
+    c.rotationsLeft = c.remaining;
+    c.cursor = &_root;
+  } else {
+    if (c.size > 0) {
+      c.arena = new Arena{static_cast<char*>(::operator new(c.bytes)), c.bytes};
+      c.pending.push_back(_root->key);
+      c.stats.blockBytes = c.bytes;
+    }
+    c.phase = Compaction::Phase::Relayout;
+  }
+}
+
+// Moves the next node in breadth-first order into the block
+void BST::relayoutStep() {
+  Compaction& c = *_compaction;
+  if (c.pending.empty()) return;
+
+  keyType k = c.pending.front();
+  c.pending.pop_front();
+
+  Node** slot = &_root;
+  std::size_t depth = 1;
+  while (!isLeaf(*slot) && (*slot)->key != k) {
+    slot = k < (*slot)->key ? &(*slot)->leftChild : &(*slot)->rightChild;
+    ++depth;
+  }
+
+  // Removed, already moved, or added after the block was sized
+  Node* old = *slot;
+  if (isLeaf(old) || old->arena == c.arena
+      || c.arena->used + old->footprint() > c.arena->capacity) return;
+
+  void* place = c.arena->block + c.arena->used;
+  c.arena->used += old->footprint();
+
+  Node* n;
+  if (old->pooled) {
+    n = new (place) PooledNode(old->key, static_cast<PooledNode*>(old)->shared);
+  } else {
+    OwnedNode* moved = new (place) OwnedNode(old->key, std::move(static_cast<OwnedNode*>(old)->item));
+    moved->countedBytes = static_cast<OwnedNode*>(old)->countedBytes;
+    n = moved;
+  }
+
+  n->arena = c.arena;
+  ++c.arena->references;
+  n->leftChild = old->leftChild;
+  n->rightChild = old->rightChild;
+  *slot = n;
+  retrack(old, n);
+  reindex(n->key, n);
+
+  if (old->arena == nullptr) {
+    ++c.stats.allocationsReleased;
+    c.stats.bytesReleased += old->footprint();
+  }
+  destroyNode(old);
+
+  ++c.stats.nodesRelocated;
+  c.depthsAfter += depth;
+  if (depth > c.stats.height) c.stats.height = depth;
+
+  if (!isLeaf(n->leftChild)) c.pending.push_back(n->leftChild->key);
+  if (!isLeaf(n->rightChild)) c.pending.push_back(n->rightChild->key);
+}
+
+void BST::buildIndex(std::size_t maxError) {
+  dropIndex();
+  _index = new LearnedIndex(maxError);
+  collectRec(_root, *_index);
+  _index->train();
+}
+
+void BST::dropIndex() {
+  delete _index;
+  _index = nullptr;
+}
+
+void BST::collectRec(Node* currentNode, LearnedIndex& index) {
+  if (isLeaf(currentNode)) return;
+
+  collectRec(currentNode->leftChild, index);
+  index.keys.push_back(currentNode->key);
+  index.nodes.push_back(currentNode);
+  collectRec(currentNode->rightChild, index);
+}
+
+// Points the index entry for k, if there is one, at a node that replaced
+// the indexed one, or at leaf() when k leaves the tree
+void BST::reindex(keyType k, Node* n) {
+  if (_index == nullptr) return;
+
+  Node** indexed = _index->find(k);
+  if (indexed != nullptr) *indexed = n;
+}
+
+// Limits of 0 leave that dimension unbounded. The recency list is only
+// kept while a limit is set; on setting the first one, the entries
+// already present count as used in key order.
+void BST::setCapacity(std::size_t maxEntries, std::size_t maxPayloadBytes) {
+  bool wasBounded = bounded();
+  _maxEntries = maxEntries;
+  _maxPayloadBytes = maxPayloadBytes;
+
+  if (bounded() != wasBounded) {
+    _mostRecent = leaf();
+    _leastRecent = leaf();
+    if (bounded()) visitRec(_root, [this](Node* n) { link(n); });
+  }
+
+  while (overCapacity() && evict()) { }
+}
+
+bool BST::bounded() const {
+  return _maxEntries > 0 || _maxPayloadBytes > 0;
+}
+
+const BST::CacheStats& BST::cacheStats() const { return _cache; }
+
+bool BST::overCapacity() const {
+  return (_maxEntries > 0 && _cache.entries > _maxEntries)
+    || (_maxPayloadBytes > 0 && _cache.payloadBytes > _maxPayloadBytes);
+}
+
+// Removes the least recently used entry, if there is one
+bool BST::evict() {
+  if (isLeaf(_leastRecent)) return false;
+
+  // Every caller evicts through here, so none can detach a node that a
+  // compaction in progress still holds the slot of
+  settleCompaction();
+  trimFinger(_leastRecent);
+  keyType k = _leastRecent->key;
+  std::size_t bytes = _leastRecent->counted();
+
+  reindex(k, leaf());
+  Node* found = detachRec(k, _root);
+  untrack(found);
+  disposeNode(found);
+
+  ++_cache.evictions;
+  _cache.evictedBytes += bytes;
+  return true;
+}
+
+// Keeps the finger usable across the removal of n. Its slot then holds
+// whatever replaces n, covering the same keys. With one child, that child
+// moves up and the steps inside it stay valid; with two, the successor
+// leaves its place below, so the path is cut at n.
+void BST::trimFinger(Node* n) {
+  for (std::size_t s = 0; s < _finger.size(); ++s) {
+    if (*_finger[s].slot != n) continue;
+
+    if (isLeaf(n->leftChild) || isLeaf(n->rightChild)) {
+      if (s + 1 < _finger.size()) _finger.erase(_finger.begin() + s + 1);
+    } else {
+      _finger.resize(s + 1);
+    }
+    return;
+  }
+}
+
+// Adds a node to the tree's accounting as the most recently used entry
+void BST::track(Node* n) {
+  if (bounded()) link(n);
+
+  ++_cache.entries;
+  n->recount();
+  _cache.payloadBytes += n->counted();
+}
+
+void BST::untrack(Node* n) {
+  if (bounded()) unlink(n);
+
+  --_cache.entries;
+  _cache.payloadBytes -= n->counted();
+}
+
+// Appends a node to the recency list as the most recently used
+void BST::link(Node* n) {
+  n->lessRecent = _mostRecent;
+  n->moreRecent = leaf();
+  if (!isLeaf(_mostRecent)) _mostRecent->moreRecent = n;
+  _mostRecent = n;
+  if (isLeaf(_leastRecent)) _leastRecent = n;
+}
+
+void BST::unlink(Node* n) {
+  if (isLeaf(n->moreRecent)) _mostRecent = n->lessRecent;
+  else n->moreRecent->lessRecent = n->lessRecent;
+
+  if (isLeaf(n->lessRecent)) _leastRecent = n->moreRecent;
+  else n->lessRecent->moreRecent = n->moreRecent;
+
+  n->moreRecent = leaf();
+  n->lessRecent = leaf();
+}
+
+// Also recounts the item, which may have changed through lookup
+void BST::touch(Node* n) {
+  untrack(n);
+  track(n);
+}
+
+// Gives a relocated node the old node's place in the recency list. The
+// item has already been moved, so the byte count is unchanged.
+void BST::retrack(Node* old, Node* n) {
+  if (!bounded()) return;
+
+  n->moreRecent = old->moreRecent;
+  n->lessRecent = old->lessRecent;
+
+  if (isLeaf(n->moreRecent)) _mostRecent = n;
+  else n->moreRecent->lessRecent = n;
+
+  if (isLeaf(n->lessRecent)) _leastRecent = n;
+  else n->lessRecent->moreRecent = n;
+}
+
+void BST::internValues(std::shared_ptr<StringPool> pool) {
+  settleCompaction();
+  _finger.clear();
+
+  std::shared_ptr<StringPool> previous = std::move(_pool);
+  _pool = std::move(pool);
+  reinternRec(_root, previous.get());
+}
+
+// Moves each item into the tree's current pool, or back into its node
+void BST::reinternRec(Node*& currentNode, StringPool* previous) {
+  if (isLeaf(currentNode)) return;
+
+  reinternRec(currentNode->leftChild, previous);
+  reinternRec(currentNode->rightChild, previous);
+
+  if (currentNode->pooled && _pool) {
+    PooledNode* n = static_cast<PooledNode*>(currentNode);
+    const itemType* moved = _pool->acquire(*n->shared);
+    previous->release(n->shared);
+    n->shared = moved;
+  } else if (currentNode->pooled) {
+    replaceNode(currentNode, new OwnedNode(currentNode->key, currentNode->value()), previous);
+  } else if (_pool) {
+    replaceNode(currentNode, makeNode(currentNode->key, currentNode->value()), previous);
+  }
+}
+
+BST::Node* BST::makeNode(keyType k, itemType i) {
+  if (_pool) return new PooledNode(k, _pool->acquire(i));
+  return new OwnedNode(k, std::move(i));
+}
+
+// Puts n in the place of the node in slot, which is freed, releasing its
+// item from the given pool if it shares one
+void BST::replaceNode(Node*& slot, Node* n, StringPool* pool) {
+  Node* old = slot;
+  n->leftChild = old->leftChild;
+  n->rightChild = old->rightChild;
+  slot = n;
+
+  retrack(old, n);
+  _cache.payloadBytes -= old->counted();
+  _cache.payloadBytes += n->counted();
+  reindex(n->key, n);
+
+  if (old->pooled) pool->release(static_cast<PooledNode*>(old)->shared);
+  destroyNode(old);
+}
+
+void BST::disposeNode(Node* n) {
+  if (isLeaf(n)) return;
+
+  if (n->pooled) _pool->release(static_cast<PooledNode*>(n)->shared);
+  destroyNode(n);
+}
+
+// Trees smaller than this are handled on the calling thread
+static const std::size_t parallelCutoff = 1 << 14;
+
+// Subtrees handed out per thread, so that faster threads can take more
+static const unsigned tasksPerThread = 4;
+
+void BST::setParallelism(unsigned threads) { _parallelism = threads; }
+
+unsigned BST::threadCount() const {
+  if (_cache.entries < parallelCutoff) return 1;
+  if (_parallelism > 0) return _parallelism;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Levels of the tree at which copy and destruction fork, giving roughly
+// one subtree per thread
+unsigned BST::forkLevels() const {
+  unsigned levels = 0;
+  while ((1u << levels) < threadCount()) ++levels;
+  return levels;
+}
+
+std::vector<BST::Task> BST::splitTasks() const {
+  unsigned threads = threadCount();
+  unsigned levels = 0;
+  while (threads > 1 && (1u << levels) < threads * tasksPerThread) ++levels;
+
+  std::vector<Task> tasks;
+  splitTasksRec(_root, levels, tasks);
+  return tasks;
+}
+
+// Splits the top levels into single nodes and the subtrees below them
+void BST::splitTasksRec(Node* currentNode, unsigned levels, std::vector<Task>& tasks) const {
+  if (isLeaf(currentNode)) return;
+
+  if (levels == 0) {
+    tasks.push_back({currentNode, true});
+    return;
+  }
+
+  splitTasksRec(currentNode->leftChild, levels - 1, tasks);
+  tasks.push_back({currentNode, false});
+  splitTasksRec(currentNode->rightChild, levels - 1, tasks);
+}
+
+// Runs run(0) .. run(count - 1) on the worker threads, each thread taking
+// the next unclaimed task when it finishes one
+void BST::runTasks(std::size_t count, const std::function<void(std::size_t)>& run) const {
+  std::atomic<std::size_t> next(0);
+  auto worker = [&] {
+    for (std::size_t t = next++; t < count; t = next++) run(t);
+  };
+
+  std::vector<std::thread> helpers;
+  for (unsigned i = 1; i < threadCount() && i < count; ++i)
+    helpers.emplace_back(worker);
+
+  worker();
+  for (std::thread& helper : helpers) helper.join();
+}
+
+void BST::visitTask(const Task& task, const std::function<void(Node*)>& visit) const {
+  if (task.wholeSubtree)
+    visitRec(task.node, visit);
+  else
+    visit(task.node);
+}
+
+void BST::visitRec(Node* currentNode, const std::function<void(Node*)>& visit) const {
+  if (isLeaf(currentNode)) return;
+
+  visitRec(currentNode->leftChild, visit);
+  visit(currentNode);
+  visitRec(currentNode->rightChild, visit);
+}
+
+void BST::forEachInRange(keyType low, keyType high,
+                         const std::function<void(keyType, const itemType&)>& f) {
+  visitRangeRec(low, high, _root, f);
+}
+
+// In-order traversal that skips subtrees lying outside [low, high]
+void BST::visitRangeRec(keyType low, keyType high, Node* currentNode,
+                        const std::function<void(keyType, const itemType&)>& f) {
+  if (isLeaf(currentNode)) return;
+
+  if (low < currentNode->key) visitRangeRec(low, high, currentNode->leftChild, f);
+  if (low <= currentNode->key && currentNode->key <= high) f(currentNode->key, currentNode->value());
+  if (currentNode->key < high) visitRangeRec(low, high, currentNode->rightChild, f);
+}
+
+BST::keyType BST::keyOf(Node* n) { return n->key; }
+
+const BST::itemType& BST::valueOf(Node* n) { return n->value(); }
+
+void BST::forEach(const std::function<void(keyType, const itemType&)>& f) {
+  std::vector<Task> tasks = splitTasks();
+
+  runTasks(tasks.size(), [&](std::size_t t) {
+    visitTask(tasks[t], [&](Node* n) { f(n->key, n->value()); });
+  });
+}
+
+// Interned items are transformed as copies and re-interned if they change
+void BST::transform(const std::function<void(keyType, itemType&)>& f) {
+  std::vector<Task> tasks = splitTasks();
+  std::vector<long long> growth(tasks.size(), 0);
+
+  runTasks(tasks.size(), [&](std::size_t t) {
+    visitTask(tasks[t], [&](Node* n) {
+      long long before = static_cast<long long>(n->counted());
+
+      if (!n->pooled) {
+        f(n->key, static_cast<OwnedNode*>(n)->item);
+      } else {
+        PooledNode* p = static_cast<PooledNode*>(n);
+        itemType changed = *p->shared;
+        f(n->key, changed);
+        if (changed != *p->shared) {
+          const itemType* previous = p->shared;
+          p->shared = _pool->acquire(changed);
+          _pool->release(previous);
+        }
+      }
+
+      n->recount();
+      growth[t] += static_cast<long long>(n->counted()) - before;
+    });
+  });
+
+  for (long long g : growth)
+    _cache.payloadBytes += static_cast<std::size_t>(g);
+  while (overCapacity() && evict()) { }
+}
@@ -1,13 +1,73 @@
 #ifndef BST_H
 #define BST_H
 
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class StringPool;
 
 class BST {
+  private:
+    struct Node;
+    struct OwnedNode;
+    struct PooledNode;
+    struct Arena;
+    struct Compaction;
+    struct LearnedIndex;
+
   public:
     using keyType = int;
     using itemType = std::string;
 
+    // Owns a node that has been detached from a tree. Reinserting the
+    // handle relinks the node itself, so no allocation or item copy occurs
+    // unless the receiving tree interns values.
+    class NodeHandle {
+      public:
+        NodeHandle() = default;
+        ~NodeHandle();
+
+        NodeHandle(const NodeHandle&) = delete;
+        NodeHandle& operator = (const NodeHandle&) = delete;
+
+        NodeHandle(NodeHandle&&);
+        NodeHandle& operator = (NodeHandle&&);
+
+        bool empty() const;
+        keyType key() const;
+        itemType& item() const;
+
+      private:
+        friend class BST;
+        explicit NodeHandle(Node*);
+
+        Node* _node = nullptr;
+    };
+
+    // Depths count the root as 1; "before" is the tree as compaction found it
+    struct CompactionStats {
+      std::size_t nodesRelocated = 0;
+      std::size_t allocationsReleased = 0; // Separately allocated nodes freed
+      std::size_t bytesReleased = 0;       // Held by those nodes, before allocator overhead
+      std::size_t blockBytes = 0;          // Size of the contiguous node block
+      std::size_t heightBefore = 0;
+      std::size_t height = 0;
+      double averageDepthBefore = 0;
+      double averageDepth = 0;
+    };
+
+    struct CacheStats {
+      std::size_t entries = 0;
+      std::size_t payloadBytes = 0;
+      std::size_t evictions = 0;
+      std::size_t evictedBytes = 0;
+    };
+
     BST() = default;
     ~BST();
 
@@ -18,26 +78,165 @@ class BST {
     BST& operator = (BST&&);
 
     itemType* lookup(keyType);
+    // Read-only access that leaves an interned item shared
+    const itemType* view(keyType);
     void insert(keyType, itemType);
     void displayEntries();
     void displayTree();
     void remove(keyType);
+    void removeRange(keyType low, keyType high);
+    NodeHandle extract(keyType);
+    void insert(NodeHandle&&);
+    CompactionStats compact();
+    bool compactStep(std::size_t);
+    const CompactionStats& lastCompaction() const;
+    void buildIndex(std::size_t maxError = 16);
+    void dropIndex();
+    // Evicts least recently used entries beyond the limits (0 = no limit).
+    // An item resized through lookup is recounted when it is overwritten,
+    // transformed or, in a bounded tree, looked up again.
+    void setCapacity(std::size_t maxEntries, std::size_t maxPayloadBytes = 0);
+    const CacheStats& cacheStats() const;
+
+    // Stores items in the given pool, or in each node again if it is null.
+    // lookup gives an entry its own copy, as the caller may change it; read
+    // with view to keep it shared. insert shares the new item again.
+    void internValues(std::shared_ptr<StringPool>);
+
+    // Starts each insert from the path to the previous one rather than the
+    // root, so nearly sorted streams insert in amortised O(1) per key
+    void setFingerSearch(bool);
+
+    // Bulk operations split the tree into subtrees and visit them on up to
+    // setParallelism threads (0 = one per core); copying and destroying a
+    // large tree also fork. The callbacks run concurrently, in no order.
+    void setParallelism(unsigned);
+    void forEach(const std::function<void(keyType, const itemType&)>&);
+    void transform(const std::function<void(keyType, itemType&)>&);
+
+    // Visits the entries with keys in [low, high] in key order
+    void forEachInRange(keyType low, keyType high,
+                        const std::function<void(keyType, const itemType&)>&);
+
+    // Combines in key order, so combine need only be associative
+    template <typename T>
+    T reduce(T identity, const std::function<T(keyType, const itemType&)>& map,
+             const std::function<T(T, T)>& combine);
 
   private:
-    struct Node;
     Node* _root = leaf();
+    Compaction* _compaction = nullptr;
+    CompactionStats _lastCompaction;
+    LearnedIndex* _index = nullptr;
+
+    // Entries in recency order for eviction, linked only while a limit is
+    // set; a limit of 0 means unbounded
+    Node* _mostRecent = leaf();
+    Node* _leastRecent = leaf();
+    std::size_t _maxEntries = 0;
+    std::size_t _maxPayloadBytes = 0;
+    CacheStats _cache;
+
+    std::shared_ptr<StringPool> _pool;
+
+    // Slot on the path to the last insertion, with the open key interval
+    // that its subtree covers
+    struct FingerStep {
+      Node** slot;
+      keyType low;
+      keyType high;
+      bool hasLow;
+      bool hasHigh;
+    };
 
-    itemType* lookupRec(keyType, Node*);
+    bool _fingerSearch = false;
+    std::vector<FingerStep> _finger;
+
+    // Either a single node or a whole subtree, in key order within a split
+    struct Task {
+      Node* node;
+      bool wholeSubtree;
+    };
+
+    unsigned _parallelism = 0;
+
+    Node* findNode(keyType);
+    Node* lookupRec(keyType, Node*);
+    Node* unshare(Node*);
     void insertRec(keyType, itemType, Node*&);
+    void insertFromFinger(keyType, itemType);
+    void overwrite(Node*&, itemType);
     void displayEntriesRec(Node*);
     void displayTreeRec(const std::string&, Node*, bool);
-    void removeRec(keyType, Node*&);
-    Node* minimumNode(Node*);
-    void deepDelete(Node*);
-    Node* deepCopy(Node*);
+    void insertNodeRec(Node*, Node*&);
+    Node* detachRec(keyType, Node*&);
+    Node* detachMinimum(Node*&);
+    void removeRangeRec(keyType, keyType, Node*&);
+    Node* keepBelow(keyType, Node*);
+    Node* keepAbove(keyType, Node*);
+    Node* join(Node*, Node*);
+    void discardSubtree(Node*);
+    void deepDelete(Node*, unsigned forks = 0);
+    Node* deepCopy(Node*, unsigned forks = 0);
+    unsigned threadCount() const;
+    unsigned forkLevels() const;
+    std::vector<Task> splitTasks() const;
+    void splitTasksRec(Node*, unsigned, std::vector<Task>&) const;
+    void runTasks(std::size_t, const std::function<void(std::size_t)>&) const;
+    void visitTask(const Task&, const std::function<void(Node*)>&) const;
+    void visitRec(Node*, const std::function<void(Node*)>&) const;
+    void visitRangeRec(keyType, keyType, Node*,
+                       const std::function<void(keyType, const itemType&)>&);
+    static keyType keyOf(Node*);
+    static const itemType& valueOf(Node*);
+    void settleCompaction();
+    void abandonCompaction();
+    void measureStep();
+    void flattenStep();
+    void balanceStep();
+    void relayoutStep();
+    void collectRec(Node*, LearnedIndex&);
+    void reindex(keyType, Node*);
+    void copyFrom(const BST&);
+    void stealFrom(BST&);
+    void pairCopiesRec(Node*, Node*, std::unordered_map<Node*, Node*>&);
+    void track(Node*);
+    void untrack(Node*);
+    void link(Node*);
+    void unlink(Node*);
+    void touch(Node*);
+    void retrack(Node*, Node*);
+    bool evict();
+    void trimFinger(Node*);
+    bool bounded() const;
+    bool overCapacity() const;
+    Node* makeNode(keyType, itemType);
+    void replaceNode(Node*&, Node*, StringPool*);
+    void reinternRec(Node*&, StringPool*);
+    void disposeNode(Node*);
+
+    static void destroyNode(Node*);
+    static void releaseArena(Arena*);
 
     static Node* leaf();
     static bool isLeaf(Node*);
 };
 
+template <typename T>
+T BST::reduce(T identity, const std::function<T(keyType, const itemType&)>& map,
+              const std::function<T(T, T)>& combine) {
+  std::vector<Task> tasks = splitTasks();
+  std::vector<T> partial(tasks.size(), identity);
+
+  runTasks(tasks.size(), [&](std::size_t t) {
+    visitTask(tasks[t], [&](Node* n) {
+      partial[t] = combine(partial[t], map(keyOf(n), valueOf(n)));
+    });
+  });
+
+  T result = identity;
+  for (T& p : partial) result = combine(result, p);
+  return result;
+}
+
 #endif
@@ -0,0 +1,248 @@
+#include "art.h"
+#include "bst.h"
+#include "shardedBst.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Dict = BST;
+using keyType = Dict::keyType;
+
+const std::size_t entryCount = 1000000;
+const std::size_t lookupCount = 2000000;
+
+std::mt19937 rng(42);
+
+// Utility functions
+
+// Runs f once and returns the elapsed time in nanoseconds per operation
+double nsPerOp(std::size_t ops, const std::function<void()>& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / ops;
+}
+
+std::vector<keyType> denseKeys() {
+  std::vector<keyType> keys(entryCount);
+  for (std::size_t i = 0; i < entryCount; ++i)
+    keys[i] = static_cast<keyType>(i);
+  return keys;
+}
+
+// Runs of consecutive ids separated by random gaps
+std::vector<keyType> clusteredKeys() {
+  std::vector<keyType> keys;
+  std::uniform_int_distribution<keyType> gap(1000, 100000);
+  keyType next = 0;
+
+  while (keys.size() < entryCount) {
+    next += gap(rng);
+    for (int i = 0; i < 1000 && keys.size() < entryCount; ++i)
+      keys.push_back(next++);
+  }
+  return keys;
+}
+
+std::vector<keyType> randomKeys() {
+  std::vector<keyType> keys;
+  std::uniform_int_distribution<keyType> any(-1000000000, 1000000000);
+
+  while (keys.size() < entryCount)
+    keys.push_back(any(rng));
+
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+// Looks up present keys in random order; returns a checksum so the loop is kept
+std::size_t lookupAll(Dict& dict, const std::vector<keyType>& probes) {
+  std::size_t found = 0;
+  for (keyType k : probes)
+    found += dict.lookup(k) != nullptr;
+  return found;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+
+void benchmarkLearnedIndex(const char* name, std::vector<keyType> keys) {
+  std::vector<keyType> probes(lookupCount);
+  std::uniform_int_distribution<std::size_t> pick(0, keys.size() - 1);
+  for (keyType& k : probes) k = keys[pick(rng)];
+
+  // Random insertion order keeps the pointer tree at a typical height
+  std::shuffle(keys.begin(), keys.end(), rng);
+  Dict dict;
+  for (keyType k : keys) dict.insert(k, "x");
+
+  std::size_t found = 0;
+  double tree = nsPerOp(probes.size(), [&] { found += lookupAll(dict, probes); });
+
+  dict.buildIndex();
+  double index = nsPerOp(probes.size(), [&] { found += lookupAll(dict, probes); });
+
+  std::printf("%-10s tree %7.1f ns  index %7.1f ns  (%zu found)\n",
+    name, tree, index, found);
+}
+
+// Mostly ascending keys, with one in every 100 swapped a short way back
+void benchmarkFingerInsert(std::size_t count) {
+  std::vector<keyType> keys(count);
+  for (std::size_t i = 0; i < count; ++i)
+    keys[i] = static_cast<keyType>(i);
+  for (std::size_t i = 100; i < count; i += 100)
+    std::swap(keys[i], keys[i - 10]);
+
+  for (bool finger : {false, true}) {
+    Dict dict;
+    dict.setFingerSearch(finger);
+    double t = nsPerOp(count, [&] { for (keyType k : keys) dict.insert(k, "x"); });
+    std::printf("%-10s %9.1f ns per insert\n", finger ? "finger" : "root", t);
+  }
+
+  // A bounded tree evicts the oldest keys as it goes, keeping the finger
+  Dict bounded;
+  bounded.setFingerSearch(true);
+  bounded.setCapacity(count / 10);
+  double t = nsPerOp(count, [&] { for (keyType k : keys) bounded.insert(k, "x"); });
+  std::printf("%-10s %9.1f ns per insert\n", "bounded", t);
+}
+
+// Bulk operations over one randomly built tree at increasing thread counts
+void benchmarkParallel() {
+  std::vector<keyType> keys = denseKeys();
+  std::shuffle(keys.begin(), keys.end(), rng);
+
+  Dict dict;
+  for (keyType k : keys) dict.insert(k, "x");
+
+  for (unsigned threads : {1u, 2u, 4u, 8u}) {
+    dict.setParallelism(threads);
+
+    double forEach = nsPerOp(keys.size(), [&] {
+      std::atomic<std::size_t> count(0);
+      dict.forEach([&](keyType, const Dict::itemType&) { ++count; });
+    });
+    double reduce = nsPerOp(keys.size(), [&] {
+      dict.reduce<long long>(0,
+        [](keyType k, const Dict::itemType&) { return static_cast<long long>(k); },
+        [](long long a, long long b) { return a + b; });
+    });
+
+    Dict* copy = nullptr;
+    double copying = nsPerOp(keys.size(), [&] { copy = new Dict(dict); });
+    double destroying = nsPerOp(keys.size(), [&] { delete copy; });
+
+    std::printf("%u threads  forEach %6.1f ns  reduce %6.1f ns  copy %6.1f ns  destroy %6.1f ns\n",
+      threads, forEach, reduce, copying, destroying);
+  }
+}
+
+// Inserts then looks up every key in random order; returns ns per insert
+// and per lookup
+template <typename Engine>
+std::pair<double, double> timeEngine(Engine& engine, const std::vector<keyType>& keys,
+                                     const std::vector<keyType>& probes) {
+  double insert = nsPerOp(keys.size(), [&] { for (keyType k : keys) engine.insert(k, "x"); });
+
+  std::size_t found = 0;
+  double lookup = nsPerOp(probes.size(), [&] { for (keyType k : probes) found += engine.lookup(k) != nullptr; });
+  if (found != probes.size()) std::printf("missing keys\n");
+
+  return {insert, lookup};
+}
+
+// Gives std::map the same interface as the engines
+struct StdMap {
+  std::map<keyType, Dict::itemType> entries;
+
+  void insert(keyType k, Dict::itemType i) { entries[k] = i; }
+  Dict::itemType* lookup(keyType k) {
+    auto found = entries.find(k);
+    return found == entries.end() ? nullptr : &found->second;
+  }
+};
+
+void benchmarkEngines(const char* name, const std::vector<keyType>& keys, bool sorted) {
+  std::vector<keyType> probes = keys;
+  std::shuffle(probes.begin(), probes.end(), rng);
+
+  ART art;
+  StdMap map;
+  auto a = timeEngine(art, keys, probes);
+  auto m = timeEngine(map, keys, probes);
+
+  // Sorted keys make the plain BST a list, so it inserts from the finger;
+  // either way it is compacted before the lookups
+  Dict dict;
+  dict.setFingerSearch(sorted);
+  double insert = nsPerOp(keys.size(), [&] { for (keyType k : keys) dict.insert(k, "x"); });
+  dict.compact();
+  double lookup = nsPerOp(probes.size(), [&] { lookupAll(dict, probes); });
+
+  std::printf("%-10s ART %6.1f / %6.1f ns  std::map %6.1f / %6.1f ns  BST %6.1f / %6.1f ns\n",
+    name, a.first, a.second, m.first, m.second, insert, lookup);
+}
+
+// Keys spread over the whole int range, written by one thread per shard;
+// the time includes waiting for the workers to drain their queues
+void benchmarkSharded(const std::vector<keyType>& keys) {
+  Dict dict;
+  double single = nsPerOp(keys.size(), [&] { for (keyType k : keys) dict.insert(k, "x"); });
+  std::printf("BST        %6.1f ns per insert\n", single);
+
+  for (unsigned shards : {1u, 2u, 4u, 8u}) {
+    ShardedBST sharded(shards);
+
+    double t = nsPerOp(keys.size(), [&] {
+      std::vector<std::thread> writers;
+      for (unsigned w = 0; w < shards; ++w) {
+        writers.emplace_back([&, w] {
+          for (std::size_t i = w; i < keys.size(); i += shards)
+            sharded.insert(keys[i], "x");
+        });
+      }
+      for (auto& writer : writers) writer.join();
+      sharded.flush();
+    });
+
+    std::printf("%u shards   %6.1f ns per insert  (%.2fx)\n", shards, t, single / t);
+  }
+}
+
+int main() {
+  std::printf("Lookup, %zu entries, %zu random present keys\n", entryCount, lookupCount);
+  benchmarkLearnedIndex("dense", denseKeys());
+  benchmarkLearnedIndex("clustered", clusteredKeys());
+  benchmarkLearnedIndex("random", randomKeys());
+
+  std::printf("\nNearly sorted insert, 20000 entries\n");
+  benchmarkFingerInsert(20000);
+
+  std::printf("\nBulk operations per entry, %zu entries, %u cores available\n",
+    entryCount, std::thread::hardware_concurrency());
+  benchmarkParallel();
+
+  std::vector<keyType> shuffled = randomKeys();
+  std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+  std::vector<keyType> spread(entryCount);
+  for (keyType& k : spread) k = static_cast<keyType>(rng());
+
+  std::printf("\nSharded insert, %zu random keys, %u cores available\n",
+    entryCount, std::thread::hardware_concurrency());
+  benchmarkSharded(spread);
+
+  std::printf("\nInsert / lookup per key, %zu 32-bit keys\n", entryCount);
+  benchmarkEngines("sequential", denseKeys(), true);
+  benchmarkEngines("random", shuffled, false);
+}
@@ -1,4 +1,6 @@
 #include "bst.h"
+#include "staticBst.h"
+#include "stringPool.h"
 
 // NOTE: Required before the include below
 #define BOOST_TEST_DYN_LINK
@@ -6,6 +8,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <map>
+#include <random>
+
 using Dict = BST;
 using keyType = Dict::keyType;
 using itemType = Dict::itemType;
@@ -23,6 +29,18 @@ void isPresent(Dict& dict, keyType k, itemType i) {
   }
 }
 
+// Reads through view, which leaves interned items shared
+void isViewed(Dict& dict, keyType k, itemType i) {
+  const itemType* p_i = dict.view(k);
+
+  BOOST_CHECK_MESSAGE(p_i, std::to_string(k) + " is missing");
+
+  if (p_i) {
+    BOOST_CHECK_MESSAGE(*p_i == i,
+      std::to_string(k) + " should be " + i + ", but found " + *p_i);
+  }
+}
+
 void isAbsent(Dict& dict, keyType k) {
   BOOST_CHECK_MESSAGE(dict.lookup(k) == nullptr,
     std::to_string(k) + " should be absent, but is present");
@@ -93,177 +111,1034 @@ BOOST_AUTO_TEST_CASE( single_overwrite_lookup ) {
 BOOST_AUTO_TEST_CASE( multiple_insert ) {
   Dict dict;
 
-  insertTestData(dict);
+  insertTestData(dict);
+}
+
+BOOST_AUTO_TEST_CASE( multiple_insert_lookup_present ) {
+  Dict dict;
+  insertTestData(dict);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( multiple_insert_lookup_absent ) {
+  Dict dict;
+  insertTestData(dict);
+
+  isAbsent(dict, 2);
+  isAbsent(dict, 3);
+  isAbsent(dict, -4);
+  isAbsent(dict, 56);
+  isAbsent(dict, 30);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( remove_tests )
+
+BOOST_AUTO_TEST_CASE( empty_remove ) {
+  Dict dict;
+
+  dict.remove(43);
+  isAbsent(dict, 43);
+}
+
+BOOST_AUTO_TEST_CASE( remove_childless_root ) {
+  Dict dict;
+
+  dict.insert(7, "John");
+  dict.remove(7);
+   
+  isAbsent(dict, 7);
+}
+
+BOOST_AUTO_TEST_CASE( remove_left_child_of_root ) {
+  Dict dict;
+
+  dict.insert(31, "Anne");
+  dict.insert(7, "John");
+
+  dict.remove(7);
+
+  isAbsent(dict, 7);
+  isPresent(dict, 31, "Anne");
+}
+
+BOOST_AUTO_TEST_CASE( remove_right_child_of_root ) {
+  Dict dict;
+
+  dict.insert(7, "John");
+  dict.insert(31, "Anne");
+  dict.remove(31);
+
+  isAbsent(dict, 31);
+  isPresent(dict, 7, "John");
+}
+
+BOOST_AUTO_TEST_CASE( insert_many_remove_childless_nodes ) {
+  Dict dict;
+
+  insertTestData(dict);
+
+  dict.remove(-1);
+  isAbsent(dict,-1);
+
+  dict.remove(1);
+  isAbsent(dict, 1);
+
+  dict.remove(19);
+  isAbsent(dict, 19);
+
+  dict.remove(23);
+  isAbsent(dict, 23);
+
+  dict.remove(31);
+  isAbsent(dict, 31);
+
+  dict.remove(42);
+  isAbsent(dict, 42);
+
+  dict.remove(4);
+  isAbsent(dict, 4);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 37, "Victoria");
+}
+
+BOOST_AUTO_TEST_CASE( overwrite_then_remove ) {
+  Dict dict;
+
+  dict.insert(22, "Jane");
+  dict.insert(22, "Mary");
+  dict.insert(4, "Matilda");
+  dict.insert(26, "Oliver");
+  dict.insert(4, "Stephen");
+  dict.insert(26, "Charles");
+
+  dict.remove(4);
+  isAbsent(dict, 4);
+
+  dict.remove(26);
+  isAbsent(dict, 26);
+
+  dict.remove(22);
+  isAbsent(dict, 22);
+}
+
+BOOST_AUTO_TEST_CASE( remove_root_with_left_child ) {
+  Dict dict;
+
+  dict.insert(31, "Anne");
+  dict.insert(7, "John");
+
+  dict.remove(31);
+
+  isAbsent(dict, 31);
+  isPresent(dict, 7, "John");
+}
+
+BOOST_AUTO_TEST_CASE( remove_root_with_right_child ) {
+  Dict dict;
+
+  dict.insert(7, "John");
+  dict.insert(31, "Anne");
+
+  dict.remove(31);
+
+  isAbsent(dict, 31);
+  isPresent(dict, 7, "John");
+}
+
+BOOST_AUTO_TEST_CASE( insert_many_remove_nodes_with_one_child ) {
+  Dict dict;
+
+  insertTestData(dict);
+
+  dict.remove(4);
+  isAbsent(dict, 4);
+
+  dict.remove(1);
+  isAbsent(dict, 1);
+
+  dict.remove(9);
+  isAbsent(dict, 9);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( remove_root_with_children ) {
+  Dict dict;
+
+  dict.insert(31, "Anne");
+  dict.insert(7, "John");
+  dict.insert(42, "Elizabeth");
+  dict.remove(31);
+
+  isAbsent(dict, 31);
+  isPresent(dict, 7, "John");
+  isPresent(dict, 42, "Elizabeth");
+}
+
+BOOST_AUTO_TEST_CASE( insert_many_remove_nodes_with_children ) {
+  Dict dict;
+
+  insertTestData(dict);
+
+  dict.remove(0);
+  isAbsent(dict, 0);
+
+  dict.remove(37);
+  isAbsent(dict, 37);
+
+  dict.remove(22);
+  isAbsent(dict, 22);
+
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( insert_many_remove_absent ) {
+  Dict dict;
+
+  insertTestData(dict);
+
+  dict.remove(6);
+  isAbsent(dict, 6);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( remove_range_tests )
+
+BOOST_AUTO_TEST_CASE( empty_remove_range ) {
+  Dict dict;
+
+  dict.removeRange(0, 43);
+  isAbsent(dict, 22);
+}
+
+BOOST_AUTO_TEST_CASE( remove_range_of_single_keys ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.removeRange(0, 0);
+  dict.removeRange(37, 37);
+  dict.removeRange(22, 22);
+  dict.removeRange(6, 6);
+
+  isAbsent(dict, 0);
+  isAbsent(dict, 37);
+  isAbsent(dict, 22);
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( remove_middle_range ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.removeRange(2, 25);
+
+  isAbsent(dict, 4);
+  isAbsent(dict, 9);
+  isAbsent(dict, 19);
+  isAbsent(dict, 22);
+  isAbsent(dict, 23);
+  isAbsent(dict, 24);
+  isPresent(dict, -1, "Edward");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 7);
+}
+
+BOOST_AUTO_TEST_CASE( remove_whole_and_reversed_range ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.removeRange(30, 10);
+  isPresent(dict, 22, "Mary");
+
+  dict.removeRange(-100, 100);
+  isAbsent(dict, 22);
+  isAbsent(dict, -1);
+  isAbsent(dict, 42);
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 0);
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 0);
+
+  dict.insert(22, "Jane");
+  isPresent(dict, 22, "Jane");
+}
+
+BOOST_AUTO_TEST_CASE( remove_range_keeps_index_and_recency ) {
+  Dict dict;
+  for (keyType k = 0; k < 1000; ++k)
+    dict.insert((k * 7919) % 1000, std::to_string(k));
+
+  dict.buildIndex(4);
+  dict.removeRange(100, 899);
+  dict.setCapacity(150);
+  dict.insert(500, "John");
+
+  for (keyType k = 100; k < 900; ++k)
+    if (k != 500) isAbsent(dict, k);
+  isPresent(dict, 500, "John");
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 150);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 51);
+}
+
+BOOST_AUTO_TEST_CASE( for_each_in_range ) {
+  Dict dict;
+  insertTestData(dict);
+
+  std::string visited;
+  dict.forEachInRange(4, 24, [&](keyType k, const itemType& i) {
+    visited += std::to_string(k) + " " + i + ", ";
+  });
+  BOOST_CHECK_EQUAL(visited, "4 Stephen, 9 Edward, 19 Henry, 22 Mary, 23 Elizabeth, 24 James, ");
+
+  std::size_t count = 0;
+  dict.forEachInRange(43, 100, [&](keyType, const itemType&) { ++count; });
+  dict.forEachInRange(24, 22, [&](keyType, const itemType&) { ++count; });
+  BOOST_CHECK_EQUAL(count, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( extract_tests )
+
+BOOST_AUTO_TEST_CASE( empty_extract ) {
+  Dict dict;
+
+  Dict::NodeHandle handle = dict.extract(43);
+  BOOST_CHECK(handle.empty());
+
+  dict.insert(std::move(handle));
+  isAbsent(dict, 43);
+}
+
+BOOST_AUTO_TEST_CASE( extract_removes_entry ) {
+  Dict dict;
+  insertTestData(dict);
+
+  Dict::NodeHandle handle = dict.extract(22);
+
+  BOOST_CHECK(!handle.empty());
+  BOOST_CHECK_EQUAL(handle.key(), 22);
+  BOOST_CHECK_EQUAL(handle.item(), "Mary");
+
+  isAbsent(dict, 22);
+  isPresent(dict, 24, "James");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 37, "Victoria");
+}
+
+BOOST_AUTO_TEST_CASE( extract_reinsert_same_dict ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.insert(dict.extract(0));
+  dict.insert(dict.extract(37));
+
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 42, "Elizabeth");
+}
+
+BOOST_AUTO_TEST_CASE( extract_reinsert_other_dict ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+
+  Dict dict_2;
+  dict_2.insert(31, "John");
+
+  dict_2.insert(dict_1.extract(9));
+  dict_2.insert(dict_1.extract(31));
+
+  isAbsent(dict_1, 9);
+  isAbsent(dict_1, 31);
+  isPresent(dict_2, 9, "Edward");
+  isPresent(dict_2, 31, "Anne");
+}
+
+BOOST_AUTO_TEST_CASE( extract_handle_is_not_reused ) {
+  Dict dict;
+  dict.insert(7, "John");
+
+  Dict::NodeHandle handle = dict.extract(7);
+  handle.item() = "Anne";
+
+  dict.insert(std::move(handle));
+  BOOST_CHECK(handle.empty());
+
+  dict.insert(std::move(handle));
+  isPresent(dict, 7, "Anne");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( compaction_tests )
+
+BOOST_AUTO_TEST_CASE( compact_empty ) {
+  Dict dict;
+
+  Dict::CompactionStats stats = dict.compact();
+
+  BOOST_CHECK_EQUAL(stats.nodesRelocated, 0);
+  isAbsent(dict, 1);
+}
+
+BOOST_AUTO_TEST_CASE( compact_keeps_entries ) {
+  Dict dict;
+  insertTestData(dict);
+
+  Dict::CompactionStats stats = dict.compact();
+
+  BOOST_CHECK_EQUAL(stats.nodesRelocated, 13);
+  BOOST_CHECK_EQUAL(stats.allocationsReleased, 13);
+  BOOST_CHECK_EQUAL(stats.bytesReleased, stats.blockBytes);
+  BOOST_CHECK_EQUAL(stats.heightBefore, 6);
+  BOOST_CHECK_EQUAL(stats.height, 4);
+  BOOST_CHECK_CLOSE(stats.averageDepthBefore, 45.0 / 13, 1e-9);
+  BOOST_CHECK_CLOSE(stats.averageDepth, 41.0 / 13, 1e-9);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( compact_balances_sorted_inserts ) {
+  Dict dict;
+
+  for (keyType k = 0; k < 1000; ++k)
+    dict.insert(k, std::to_string(k));
+
+  Dict::CompactionStats stats = dict.compact();
+  BOOST_CHECK_EQUAL(stats.heightBefore, 1000);
+  BOOST_CHECK_EQUAL(stats.height, 10);
+  BOOST_CHECK_CLOSE(stats.averageDepthBefore, 500.5, 1e-9);
+  BOOST_CHECK(stats.averageDepth < 10);
+
+  // Already in the block, so nothing more is freed
+  BOOST_CHECK_EQUAL(dict.compact().bytesReleased, 0);
+
+  for (keyType k = 0; k < 1000; ++k)
+    isPresent(dict, k, std::to_string(k));
+}
+
+BOOST_AUTO_TEST_CASE( compact_in_steps ) {
+  Dict dict;
+  insertTestData(dict);
+
+  std::size_t steps = 1;
+  while (!dict.compactStep(1)) {
+    ++steps;
+    isPresent(dict, 37, "Victoria");
+  }
+
+  BOOST_CHECK(steps > 13);
+  BOOST_CHECK_EQUAL(dict.lastCompaction().nodesRelocated, 13);
+  isPresent(dict, -1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( change_during_compaction ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.compactStep(5);
+  dict.remove(22);
+  dict.compactStep(5);
+  dict.insert(2, "John");
+  dict.compact();
+
+  isAbsent(dict, 22);
+  isPresent(dict, 2, "John");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 42, "Elizabeth");
+}
+
+// Slices small enough that a write lands in every phase, as when
+// compaction runs between requests
+BOOST_AUTO_TEST_CASE( compaction_survives_interleaved_writes ) {
+  Dict dict;
+  std::map<keyType, itemType> expected;
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<keyType> key(0, 1000000);
+
+  for (int step = 0; step < 10000; ++step) {
+    keyType k = key(rng);
+    dict.insert(k, std::to_string(step));
+    expected[k] = std::to_string(step);
+  }
+
+  std::size_t finished = 0;
+  for (int slice = 0; slice < 400; ++slice) {
+    if (dict.compactStep(100)) ++finished;
+
+    keyType k = key(rng);
+    if (slice % 3 == 0) {
+      k = expected.lower_bound(k) == expected.end() ? k : expected.lower_bound(k)->first;
+      dict.remove(k);
+      expected.erase(k);
+    } else {
+      dict.insert(k, "slice " + std::to_string(slice));
+      expected[k] = "slice " + std::to_string(slice);
+    }
+  }
+
+  // A balanced tree of this size has 14 levels
+  BOOST_CHECK(finished >= 3);
+  BOOST_CHECK(dict.lastCompaction().height <= 16);
+
+  for (auto& entry : expected)
+    isPresent(dict, entry.first, entry.second);
+}
+
+BOOST_AUTO_TEST_CASE( remove_and_extract_after_compaction ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+  dict_1.compact();
+  dict_1.compact();
+
+  Dict dict_2;
+  dict_2.insert(dict_1.extract(9));
+
+  dict_1.remove(22);
+  dict_1.insert(31, "John");
+
+  isAbsent(dict_1, 9);
+  isAbsent(dict_1, 22);
+  isPresent(dict_1, 31, "John");
+  isPresent(dict_2, 9, "Edward");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( learned_index_tests )
+
+BOOST_AUTO_TEST_CASE( index_empty ) {
+  Dict dict;
+
+  dict.buildIndex();
+  isAbsent(dict, 1);
+
+  dict.insert(1, "John");
+  isPresent(dict, 1, "John");
+}
+
+BOOST_AUTO_TEST_CASE( index_lookup_present_absent ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.buildIndex(1);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 24, "James");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, 19, "Henry");
+  isPresent(dict, 31, "Anne");
+  isPresent(dict, 23, "Elizabeth");
+  isPresent(dict, 37, "Victoria");
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, -1, "Edward");
+
+  isAbsent(dict, -2);
+  isAbsent(dict, 2);
+  isAbsent(dict, 25);
+  isAbsent(dict, 43);
+}
+
+BOOST_AUTO_TEST_CASE( index_sees_later_changes ) {
+  Dict dict;
+  insertTestData(dict);
+
+  dict.buildIndex();
+
+  dict.insert(2, "John");
+  dict.insert(24, "Anne");
+  dict.remove(22);
+  dict.remove(9);
+  dict.insert(9, "Matilda");
+
+  isPresent(dict, 2, "John");
+  isPresent(dict, 24, "Anne");
+  isAbsent(dict, 22);
+  isPresent(dict, 9, "Matilda");
+}
+
+BOOST_AUTO_TEST_CASE( index_survives_extract_and_compaction ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+
+  dict_1.buildIndex();
+
+  Dict dict_2;
+  dict_2.insert(31, "John");
+  dict_2.buildIndex();
+
+  dict_2.insert(dict_1.extract(31));
+  dict_1.compact();
+
+  isAbsent(dict_1, 31);
+  isPresent(dict_1, 26, "Charles");
+  isPresent(dict_2, 31, "Anne");
+}
+
+BOOST_AUTO_TEST_CASE( index_large_distributions ) {
+  Dict dense, clustered;
+
+  for (keyType k = 0; k < 2000; ++k) {
+    dense.insert((k * 7919) % 2000, "x");
+    clustered.insert((k / 100) * 10000 + k % 100, "y");
+  }
+
+  dense.buildIndex(4);
+  clustered.buildIndex(4);
+
+  for (keyType k = 0; k < 2000; ++k) {
+    isPresent(dense, k, "x");
+    isPresent(clustered, (k / 100) * 10000 + k % 100, "y");
+    isAbsent(clustered, (k / 100) * 10000 + 100 + k % 100);
+  }
+
+  isAbsent(dense, 2000);
+  isAbsent(dense, -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( capacity_tests )
+
+BOOST_AUTO_TEST_CASE( unbounded_accounting ) {
+  Dict dict;
+  insertTestData(dict);
+
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 13);
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 83);
+
+  dict.insert(22, "Jane");
+  dict.remove(42);
+  dict.remove(6);
+
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 12);
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 74);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 0);
+}
+
+BOOST_AUTO_TEST_CASE( entry_limit_evicts_least_recent ) {
+  Dict dict;
+  dict.setCapacity(3);
+
+  dict.insert(1, "Anne");
+  dict.insert(2, "John");
+  dict.insert(3, "Mary");
+  dict.lookup(1);
+  dict.insert(4, "Jane");
+
+  isAbsent(dict, 2);
+  isPresent(dict, 1, "Anne");
+  isPresent(dict, 3, "Mary");
+  isPresent(dict, 4, "Jane");
+
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 3);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 1);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictedBytes, 4);
+}
+
+BOOST_AUTO_TEST_CASE( byte_limit_counts_overwrites ) {
+  Dict dict;
+  dict.setCapacity(0, 12);
+
+  dict.insert(1, "Anne");
+  dict.insert(2, "John");
+  dict.insert(3, "Mary");
+  dict.insert(1, "Victoria");
+
+  isAbsent(dict, 2);
+  isPresent(dict, 1, "Victoria");
+  isPresent(dict, 3, "Mary");
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 12);
+}
+
+// Items may be changed through lookup without the tree seeing it
+BOOST_AUTO_TEST_CASE( resizing_through_lookup ) {
+  Dict dict;
+  dict.setCapacity(0, 100);
+
+  dict.insert(1, "a");
+  *dict.lookup(1) = std::string(50, 'x');
+  dict.remove(1);
+  dict.insert(2, "b");
+
+  isPresent(dict, 2, "b");
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 1);
+
+  *dict.lookup(2) = std::string(60, 'y');
+  dict.lookup(2);
+  dict.insert(3, std::string(50, 'z'));
+
+  isAbsent(dict, 2);
+  isPresent(dict, 3, std::string(50, 'z'));
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 50);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictedBytes, 60);
+}
+
+BOOST_AUTO_TEST_CASE( shrinking_capacity_evicts ) {
+  Dict dict;
+  dict.setCapacity(20);
+  insertTestData(dict);
+
+  dict.setCapacity(2);
+
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 2);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 11);
+  isPresent(dict, 1, "William");
+  isPresent(dict, 26, "Charles");
+}
+
+// Copies take the counts as they stand, even for an item resized unseen
+BOOST_AUTO_TEST_CASE( unbounded_copy_keeps_counts ) {
+  Dict dict_1;
+  insertTestData(dict_1);
+  dict_1.lookup(9)->append(100, 'x');
+
+  Dict dict_2(dict_1);
+  BOOST_CHECK_EQUAL(dict_2.cacheStats().entries, 13);
+  BOOST_CHECK_EQUAL(dict_2.cacheStats().payloadBytes, dict_1.cacheStats().payloadBytes);
+
+  dict_2.remove(9);
+  dict_2.remove(42);
+  BOOST_CHECK_EQUAL(dict_2.cacheStats().payloadBytes, 83 - 6 - 9);
 }
 
-BOOST_AUTO_TEST_CASE( multiple_insert_lookup_present ) {
+// An unbounded tree keeps no recency, so the first limit goes by key
+BOOST_AUTO_TEST_CASE( first_limit_evicts_in_key_order ) {
   Dict dict;
   insertTestData(dict);
 
-  isPresent(dict, 22, "Mary");
-  isPresent(dict, 4, "Stephen");
-  isPresent(dict, 9, "Edward");
-  isPresent(dict, 1, "William");
-  isPresent(dict, 0, "Harold");
-  isPresent(dict, 24, "James");
-  isPresent(dict, 26, "Charles");
-  isPresent(dict, 19, "Henry");
-  isPresent(dict, 31, "Anne");
-  isPresent(dict, 23, "Elizabeth");
+  dict.setCapacity(2);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 11);
   isPresent(dict, 37, "Victoria");
   isPresent(dict, 42, "Elizabeth");
-  isPresent(dict, -1, "Edward");
+
+  dict.setCapacity(0);
+  dict.insert(1, "William");
+  dict.insert(50, "Anne");
+  dict.setCapacity(2);
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 13);
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, 50, "Anne");
 }
 
-BOOST_AUTO_TEST_CASE( multiple_insert_lookup_absent ) {
+BOOST_AUTO_TEST_CASE( copy_keeps_recency ) {
+  Dict dict_1;
+  dict_1.setCapacity(10);
+  dict_1.insert(2, "John");
+  dict_1.insert(1, "Anne");
+  dict_1.insert(3, "Mary");
+  dict_1.lookup(2);
+
+  Dict dict_2(dict_1);
+  dict_2.setCapacity(2);
+
+  isAbsent(dict_2, 1);
+  isPresent(dict_2, 2, "John");
+  isPresent(dict_2, 3, "Mary");
+  isPresent(dict_1, 1, "Anne");
+}
+
+BOOST_AUTO_TEST_CASE( recency_survives_extract_and_compaction ) {
   Dict dict;
+  dict.setCapacity(20);
   insertTestData(dict);
+  dict.compact();
 
-  isAbsent(dict, 2);
-  isAbsent(dict, 3);
-  isAbsent(dict, -4);
-  isAbsent(dict, 56);
-  isAbsent(dict, 30);
+  Dict other;
+  other.insert(dict.extract(9));
+  dict.setCapacity(11);
+
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 11);
+  BOOST_CHECK_EQUAL(other.cacheStats().entries, 1);
+  isAbsent(dict, 22);
+  isPresent(dict, 26, "Charles");
 }
 
 BOOST_AUTO_TEST_SUITE_END()
 
 //////////////////////////////////////////////////////////////////////////////////
 
-BOOST_AUTO_TEST_SUITE( remove_tests )
+BOOST_AUTO_TEST_SUITE( interning_tests )
 
-BOOST_AUTO_TEST_CASE( empty_remove ) {
+// Saving of one more reference to a string stored inline
+const std::ptrdiff_t shortSaving = sizeof(std::string) - sizeof(const std::string*);
+
+BOOST_AUTO_TEST_CASE( interned_lookup ) {
+  auto pool = std::make_shared<StringPool>();
   Dict dict;
+  dict.internValues(pool);
+  insertTestData(dict);
 
-  dict.remove(43);
-  isAbsent(dict, 43);
-}
+  isViewed(dict, 22, "Mary");
+  isViewed(dict, 9, "Edward");
+  isViewed(dict, -1, "Edward");
+  isViewed(dict, 23, "Elizabeth");
+  isViewed(dict, 42, "Elizabeth");
 
-BOOST_AUTO_TEST_CASE( remove_childless_root ) {
-  Dict dict;
+  BOOST_CHECK(dict.view(9) == dict.view(-1));
+  BOOST_CHECK_EQUAL(pool->size(), 11);
 
-  dict.insert(7, "John");
-  dict.remove(7);
-   
-  isAbsent(dict, 7);
+  // Mostly unique short names cost more in pool entries than they save
+  std::ptrdiff_t saved = pool->bytesSaved();
+  BOOST_CHECK(saved < 0);
+
+  dict.insert(2, "Victoria");
+  BOOST_CHECK_EQUAL(pool->bytesSaved(), saved + shortSaving);
 }
 
-BOOST_AUTO_TEST_CASE( remove_left_child_of_root ) {
-  Dict dict;
+BOOST_AUTO_TEST_CASE( net_bytes_saved ) {
+  StringPool pool;
+  std::string name(100, 'x');
 
-  dict.insert(31, "Anne");
-  dict.insert(7, "John");
+  const std::string* first = pool.acquire(name);
+  std::ptrdiff_t saved = pool.bytesSaved();
+  BOOST_CHECK(saved < 0);
 
-  dict.remove(7);
+  pool.acquire(name);
+  pool.retain(first);
+  BOOST_CHECK_EQUAL(pool.bytesSaved(), saved + 2 * (shortSaving + 101));
 
-  isAbsent(dict, 7);
-  isPresent(dict, 31, "Anne");
+  pool.release(first);
+  pool.release(first);
+  pool.release(first);
+  BOOST_CHECK_EQUAL(pool.size(), 0);
+  BOOST_CHECK_EQUAL(pool.bytesSaved(), 0);
 }
 
-BOOST_AUTO_TEST_CASE( remove_right_child_of_root ) {
+BOOST_AUTO_TEST_CASE( intern_existing_entries ) {
+  auto pool = std::make_shared<StringPool>();
   Dict dict;
+  insertTestData(dict);
 
-  dict.insert(7, "John");
-  dict.insert(31, "Anne");
-  dict.remove(31);
+  dict.internValues(pool);
+  BOOST_CHECK_EQUAL(pool->size(), 11);
+  BOOST_CHECK(dict.view(23) == dict.view(42));
+  isViewed(dict, 42, "Elizabeth");
 
-  isAbsent(dict, 31);
-  isPresent(dict, 7, "John");
+  dict.internValues(nullptr);
+  BOOST_CHECK_EQUAL(pool->size(), 0);
+  isPresent(dict, 42, "Elizabeth");
+  isPresent(dict, 4, "Stephen");
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 83);
 }
 
-BOOST_AUTO_TEST_CASE( insert_many_remove_childless_nodes ) {
+BOOST_AUTO_TEST_CASE( interned_overwrite_and_remove ) {
+  auto pool = std::make_shared<StringPool>();
   Dict dict;
-
+  dict.internValues(pool);
   insertTestData(dict);
 
-  dict.remove(-1);
-  isAbsent(dict,-1);
-
-  dict.remove(1);
-  isAbsent(dict, 1);
-
-  dict.remove(19);
-  isAbsent(dict, 19);
-
-  dict.remove(23);
-  isAbsent(dict, 23);
-
-  dict.remove(31);
-  isAbsent(dict, 31);
-
+  dict.insert(-1, "Anne");
+  dict.remove(9);
   dict.remove(42);
-  isAbsent(dict, 42);
-
-  dict.remove(4);
-  isAbsent(dict, 4);
 
-  isPresent(dict, 22, "Mary");
-  isPresent(dict, 9, "Edward");
-  isPresent(dict, 0, "Harold");
-  isPresent(dict, 24, "James");
-  isPresent(dict, 26, "Charles");
-  isPresent(dict, 37, "Victoria");
+  isViewed(dict, -1, "Anne");
+  isViewed(dict, 31, "Anne");
+  isViewed(dict, 23, "Elizabeth");
+  BOOST_CHECK_EQUAL(pool->size(), 10);
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 66);
 }
 
-BOOST_AUTO_TEST_CASE( overwrite_then_remove ) {
+// Changing an item through lookup must not reach the other entries sharing it
+BOOST_AUTO_TEST_CASE( lookup_unshares ) {
+  auto pool = std::make_shared<StringPool>();
   Dict dict;
+  dict.internValues(pool);
+  insertTestData(dict);
 
-  dict.insert(22, "Jane");
-  dict.insert(22, "Mary");
-  dict.insert(4, "Matilda");
-  dict.insert(26, "Oliver");
-  dict.insert(4, "Stephen");
-  dict.insert(26, "Charles");
+  *dict.lookup(9) = "Victoria";
 
-  dict.remove(4);
-  isAbsent(dict, 4);
+  isViewed(dict, -1, "Edward");
+  isViewed(dict, 37, "Victoria");
+  isViewed(dict, 9, "Victoria");
+  BOOST_CHECK(dict.view(9) != dict.view(37));
+  BOOST_CHECK_EQUAL(pool->size(), 11);
 
-  dict.remove(26);
-  isAbsent(dict, 26);
+  dict.remove(-1);
+  BOOST_CHECK_EQUAL(pool->size(), 10);
 
-  dict.remove(22);
-  isAbsent(dict, 22);
+  dict.insert(9, "Edward");
+  isViewed(dict, 9, "Edward");
+  BOOST_CHECK_EQUAL(pool->size(), 11);
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, 77);
 }
 
-BOOST_AUTO_TEST_CASE( remove_root_with_left_child ) {
-  Dict dict;
+BOOST_AUTO_TEST_CASE( interned_copy_shares_values ) {
+  auto pool = std::make_shared<StringPool>();
+  std::ptrdiff_t saved;
 
-  dict.insert(31, "Anne");
-  dict.insert(7, "John");
+  {
+    Dict dict_1;
+    dict_1.internValues(pool);
+    insertTestData(dict_1);
+    saved = pool->bytesSaved();
 
-  dict.remove(31);
+    Dict dict_2(dict_1);
+    BOOST_CHECK_EQUAL(pool->bytesSaved(), saved + 13 * shortSaving);
+    BOOST_CHECK(dict_1.view(4) == dict_2.view(4));
 
-  isAbsent(dict, 31);
-  isPresent(dict, 7, "John");
+    dict_2.insert(4, "Matilda");
+    isViewed(dict_1, 4, "Stephen");
+    isViewed(dict_2, 4, "Matilda");
+  }
+
+  BOOST_CHECK_EQUAL(pool->size(), 0);
+  BOOST_CHECK_EQUAL(pool->bytesSaved(), 0);
 }
 
-BOOST_AUTO_TEST_CASE( remove_root_with_right_child ) {
-  Dict dict;
+BOOST_AUTO_TEST_CASE( interned_extract_between_pools ) {
+  Dict dict_1;
+  dict_1.internValues(std::make_shared<StringPool>());
+  insertTestData(dict_1);
 
-  dict.insert(7, "John");
-  dict.insert(31, "Anne");
+  Dict dict_2;
+  Dict dict_3;
+  dict_3.internValues(std::make_shared<StringPool>());
 
-  dict.remove(31);
+  Dict::NodeHandle handle = dict_1.extract(37);
+  BOOST_CHECK_EQUAL(handle.item(), "Victoria");
 
-  isAbsent(dict, 31);
-  isPresent(dict, 7, "John");
+  dict_2.insert(std::move(handle));
+  dict_3.insert(dict_1.extract(31));
+  dict_1.compact();
+
+  isPresent(dict_2, 37, "Victoria");
+  isViewed(dict_3, 31, "Anne");
+  isPresent(dict_1, 26, "Charles");
 }
 
-BOOST_AUTO_TEST_CASE( insert_many_remove_nodes_with_one_child ) {
+// Entries shared and unshared while a compaction moves them
+BOOST_AUTO_TEST_CASE( interned_compaction ) {
+  auto pool = std::make_shared<StringPool>();
   Dict dict;
+  dict.internValues(pool);
+  for (keyType k = 0; k < 1000; ++k)
+    dict.insert((k * 7919) % 1000, std::to_string(k % 10));
+
+  std::size_t pooledBytes = dict.compact().blockBytes;
+  while (!dict.compactStep(50)) {
+    *dict.lookup(7919 % 1000) = "changed";
+    dict.insert(2 * 7919 % 1000, "2");
+  }
 
-  insertTestData(dict);
+  // The one entry with its own copy takes more room in the next block
+  Dict::CompactionStats stats = dict.compact();
+  BOOST_CHECK_EQUAL(stats.nodesRelocated, 1000);
+  BOOST_CHECK(stats.blockBytes > pooledBytes);
+  isViewed(dict, 0, "0");
+  isPresent(dict, 7919 % 1000, "changed");
+  BOOST_CHECK_EQUAL(pool->size(), 10);
+}
 
-  dict.remove(4);
-  isAbsent(dict, 4);
+BOOST_AUTO_TEST_SUITE_END()
 
-  dict.remove(1);
-  isAbsent(dict, 1);
+//////////////////////////////////////////////////////////////////////////////////
 
-  dict.remove(9);
-  isAbsent(dict, 9);
+BOOST_AUTO_TEST_SUITE( finger_search_tests )
+
+BOOST_AUTO_TEST_CASE( finger_insert_test_data ) {
+  Dict dict;
+  dict.setFingerSearch(true);
+  insertTestData(dict);
 
   isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 9, "Edward");
+  isPresent(dict, 1, "William");
   isPresent(dict, 0, "Harold");
   isPresent(dict, 24, "James");
   isPresent(dict, 26, "Charles");
@@ -273,68 +1148,216 @@ BOOST_AUTO_TEST_CASE( insert_many_remove_nodes_with_one_child ) {
   isPresent(dict, 37, "Victoria");
   isPresent(dict, 42, "Elizabeth");
   isPresent(dict, -1, "Edward");
+  BOOST_CHECK_EQUAL(dict.cacheStats().entries, 13);
 }
 
-BOOST_AUTO_TEST_CASE( remove_root_with_children ) {
+BOOST_AUTO_TEST_CASE( finger_insert_nearly_sorted ) {
   Dict dict;
+  dict.setFingerSearch(true);
 
-  dict.insert(31, "Anne");
-  dict.insert(7, "John");
-  dict.insert(42, "Elizabeth");
-  dict.remove(31);
+  for (keyType k = 0; k < 1000; ++k)
+    dict.insert(k % 10 == 0 ? k + 5 : k, std::to_string(k));
 
-  isAbsent(dict, 31);
-  isPresent(dict, 7, "John");
-  isPresent(dict, 42, "Elizabeth");
+  for (keyType k = 0; k < 1000; ++k) {
+    if (k % 10 == 0) isAbsent(dict, k);
+    else isPresent(dict, k, std::to_string(k));
+  }
 }
 
-BOOST_AUTO_TEST_CASE( insert_many_remove_nodes_with_children ) {
+BOOST_AUTO_TEST_CASE( finger_insert_after_structural_changes ) {
   Dict dict;
-
+  dict.setFingerSearch(true);
   insertTestData(dict);
 
-  dict.remove(0);
-  isAbsent(dict, 0);
+  dict.remove(24);
+  dict.insert(25, "John");
+  dict.compact();
+  dict.insert(43, "Anne");
+  dict.insert(dict.extract(0));
+  dict.insert(2, "Jane");
 
-  dict.remove(37);
-  isAbsent(dict, 37);
+  isAbsent(dict, 24);
+  isPresent(dict, 25, "John");
+  isPresent(dict, 43, "Anne");
+  isPresent(dict, 0, "Harold");
+  isPresent(dict, 2, "Jane");
+}
 
-  dict.remove(22);
-  isAbsent(dict, 22);
+BOOST_AUTO_TEST_CASE( finger_insert_with_eviction ) {
+  Dict dict;
+  dict.setFingerSearch(true);
+  dict.setCapacity(3);
 
-  isPresent(dict, 4, "Stephen");
-  isPresent(dict, 9, "Edward");
-  isPresent(dict, 1, "William");
-  isPresent(dict, 24, "James");
-  isPresent(dict, 26, "Charles");
-  isPresent(dict, 19, "Henry");
-  isPresent(dict, 31, "Anne");
-  isPresent(dict, 23, "Elizabeth");
-  isPresent(dict, 42, "Elizabeth");
-  isPresent(dict, -1, "Edward");
+  for (keyType k = 0; k < 10; ++k)
+    dict.insert(k, "x");
+
+  isAbsent(dict, 6);
+  isPresent(dict, 7, "x");
+  isPresent(dict, 9, "x");
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, 7);
 }
 
-BOOST_AUTO_TEST_CASE( insert_many_remove_absent ) {
+// Evictions keep the finger, so it must still lead to the right slots
+BOOST_AUTO_TEST_CASE( finger_kept_across_evictions ) {
+  Dict dict;
+  dict.setFingerSearch(true);
+  dict.setCapacity(200);
+  Dict expected;
+  expected.setCapacity(200);
+
+  std::mt19937 rng(11);
+  for (int step = 0; step < 20000; ++step) {
+    keyType k = step % 3 == 0 ? static_cast<keyType>(rng() % 1000) : step;
+    dict.insert(k, std::to_string(step));
+    expected.insert(k, std::to_string(step));
+    if (step % 7 == 0) {
+      dict.lookup(k / 2);
+      expected.lookup(k / 2);
+    }
+  }
+
+  for (keyType k = 0; k < 20000; ++k) {
+    itemType* found = expected.lookup(k);
+    if (found != nullptr) isPresent(dict, k, *found);
+    else isAbsent(dict, k);
+  }
+  BOOST_CHECK_EQUAL(dict.cacheStats().evictions, expected.cacheStats().evictions);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( parallel_tests )
+
+// Large enough for bulk operations to split across threads
+const keyType largeCount = 50000;
+
+void insertLargeData(Dict& dict) {
+  for (keyType k = 0; k < largeCount; ++k)
+    dict.insert((k * 7919) % largeCount, std::to_string(k % 100));
+}
+
+BOOST_AUTO_TEST_CASE( for_each_visits_every_entry ) {
   Dict dict;
+  dict.setParallelism(4);
+  insertLargeData(dict);
 
+  std::atomic<long long> keySum(0);
+  std::atomic<std::size_t> count(0);
+  dict.forEach([&](keyType k, const itemType&) { keySum += k; ++count; });
+
+  BOOST_CHECK_EQUAL(count, static_cast<std::size_t>(largeCount));
+  BOOST_CHECK_EQUAL(keySum, static_cast<long long>(largeCount) * (largeCount - 1) / 2);
+}
+
+BOOST_AUTO_TEST_CASE( reduce_combines_in_key_order ) {
+  Dict dict;
+  dict.setParallelism(4);
   insertTestData(dict);
 
-  dict.remove(6);
-  isAbsent(dict, 6);
+  std::string keys = dict.reduce<std::string>("",
+    [](keyType k, const itemType&) { return std::to_string(k) + " "; },
+    [](std::string a, std::string b) { return a + b; });
+  BOOST_CHECK_EQUAL(keys, "-1 0 1 4 9 19 22 23 24 26 31 37 42 ");
 
-  isPresent(dict, 22, "Mary");
-  isPresent(dict, 4, "Stephen");
-  isPresent(dict, 9, "Edward");
-  isPresent(dict, 1, "William");
-  isPresent(dict, 0, "Harold");
-  isPresent(dict, 24, "James");
-  isPresent(dict, 26, "Charles");
-  isPresent(dict, 19, "Henry");
-  isPresent(dict, 31, "Anne");
-  isPresent(dict, 23, "Elizabeth");
-  isPresent(dict, 37, "Victoria");
-  isPresent(dict, 42, "Elizabeth");
-  isPresent(dict, -1, "Edward");
+  Dict large;
+  large.setParallelism(4);
+  insertLargeData(large);
+
+  long long keySum = large.reduce<long long>(0,
+    [](keyType k, const itemType&) { return static_cast<long long>(k); },
+    [](long long a, long long b) { return a + b; });
+
+  BOOST_CHECK_EQUAL(keySum, static_cast<long long>(largeCount) * (largeCount - 1) / 2);
+}
+
+// Keys seen by a combined result, and whether they arrived in order
+struct KeySpan {
+  bool empty;
+  keyType first;
+  keyType last;
+  bool ordered;
+  std::size_t count;
+};
+
+// Associative but not commutative, so any combine out of key order shows
+BOOST_AUTO_TEST_CASE( reduce_keeps_key_order_across_tasks ) {
+  Dict dict;
+  dict.setParallelism(4);
+  insertLargeData(dict);
+
+  KeySpan span = dict.reduce<KeySpan>({true, 0, 0, true, 0},
+    [](keyType k, const itemType&) { return KeySpan{false, k, k, true, 1}; },
+    [](KeySpan a, KeySpan b) {
+      if (a.empty) return b;
+      if (b.empty) return a;
+      return KeySpan{false, a.first, b.last, a.ordered && b.ordered && a.last < b.first,
+                     a.count + b.count};
+    });
+
+  BOOST_CHECK(span.ordered);
+  BOOST_CHECK_EQUAL(span.first, 0);
+  BOOST_CHECK_EQUAL(span.last, largeCount - 1);
+  BOOST_CHECK_EQUAL(span.count, static_cast<std::size_t>(largeCount));
+}
+
+BOOST_AUTO_TEST_CASE( transform_updates_items_and_bytes ) {
+  Dict dict;
+  dict.setParallelism(4);
+  insertLargeData(dict);
+  dict.internValues(std::make_shared<StringPool>());
+
+  std::size_t bytes = dict.cacheStats().payloadBytes;
+  dict.transform([](keyType k, itemType& i) { if (k % 2 == 0) i += "!"; });
+
+  isPresent(dict, 0, "0!");
+  isPresent(dict, 7919, "1");
+  BOOST_CHECK_EQUAL(dict.cacheStats().payloadBytes, bytes + largeCount / 2);
+}
+
+// Growing items evict entries while a compaction is part way through
+BOOST_AUTO_TEST_CASE( transform_evicts_during_compaction ) {
+  Dict dict;
+  dict.setParallelism(4);
+  insertLargeData(dict);
+  dict.setCapacity(0, dict.cacheStats().payloadBytes);
+
+  dict.compactStep(300);
+  dict.transform([](keyType, itemType& i) { i += "!"; });
+  BOOST_CHECK(dict.cacheStats().evictions > 0);
+
+  dict.compactStep(300);
+  dict.compact();
+
+  std::atomic<std::size_t> found(0);
+  std::atomic<bool> allChanged(true);
+  dict.forEach([&](keyType, const itemType& i) {
+    if (i.back() != '!') allChanged = false;
+    ++found;
+  });
+
+  BOOST_CHECK(allChanged);
+  BOOST_CHECK_EQUAL(found, dict.cacheStats().entries);
+  BOOST_CHECK_EQUAL(found + dict.cacheStats().evictions, static_cast<std::size_t>(largeCount));
+  BOOST_CHECK(dict.lastCompaction().height <= 16);
+}
+
+BOOST_AUTO_TEST_CASE( parallel_copy_and_destroy ) {
+  Dict* dict_1 = new Dict();
+  dict_1->setParallelism(4);
+  insertLargeData(*dict_1);
+  dict_1->compact();
+
+  Dict dict_2(*dict_1);
+  delete dict_1;
+
+  BOOST_CHECK_EQUAL(dict_2.cacheStats().entries, static_cast<std::size_t>(largeCount));
+  isPresent(dict_2, 7919, "1");
+  isPresent(dict_2, 0, "0");
+
+  dict_2 = Dict();
+  isAbsent(dict_2, 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -661,3 +1684,65 @@ BOOST_AUTO_TEST_CASE( move_self_assignment ) {
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( static_bst_tests )
+
+constexpr auto staticDict = makeStaticBST({
+  {9, "Edward"}, {22, "Jane"}, {22, "Mary"}, {0, "Harold"},
+  {37, "Victoria"}, {4, "Matilda"}, {26, "Oliver"}, {42, "Elizabeth"},
+  {19, "Henry"}, {4, "Stephen"}, {24, "James"}, {-1, "Edward"},
+  {31, "Anne"}, {23, "Elizabeth"}, {1, "William"}, {26, "Charles"}
+});
+
+static_assert(staticDict.size() == 13, "duplicate keys should be merged");
+static_assert(staticDict.lookup(22) != nullptr, "22 should be present");
+static_assert(staticDict.lookup(6) == nullptr, "6 should be absent");
+
+void isStaticPresent(StaticBST<16>::keyType k, std::string i) {
+  const StaticBST<16>::itemType* p_i = staticDict.lookup(k);
+
+  BOOST_CHECK_MESSAGE(p_i, std::to_string(k) + " is missing");
+
+  if (p_i) {
+    BOOST_CHECK_MESSAGE(*p_i == i,
+      std::to_string(k) + " should be " + i + ", but found " + *p_i);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( static_lookup_present ) {
+  isStaticPresent(22, "Mary");
+  isStaticPresent(4, "Stephen");
+  isStaticPresent(9, "Edward");
+  isStaticPresent(1, "William");
+  isStaticPresent(0, "Harold");
+  isStaticPresent(24, "James");
+  isStaticPresent(26, "Charles");
+  isStaticPresent(19, "Henry");
+  isStaticPresent(31, "Anne");
+  isStaticPresent(23, "Elizabeth");
+  isStaticPresent(37, "Victoria");
+  isStaticPresent(42, "Elizabeth");
+  isStaticPresent(-1, "Edward");
+}
+
+BOOST_AUTO_TEST_CASE( static_lookup_absent ) {
+  BOOST_CHECK(staticDict.lookup(-2) == nullptr);
+  BOOST_CHECK(staticDict.lookup(2) == nullptr);
+  BOOST_CHECK(staticDict.lookup(25) == nullptr);
+  BOOST_CHECK(staticDict.lookup(43) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( static_lookup_every_size ) {
+  // Exercises incomplete bottom levels of the implicit tree
+  constexpr auto small = makeStaticBST({{3, "c"}, {1, "a"}, {2, "b"}, {5, "e"}, {4, "d"}});
+
+  BOOST_CHECK_EQUAL(*small.lookup(1), std::string("a"));
+  BOOST_CHECK_EQUAL(*small.lookup(3), std::string("c"));
+  BOOST_CHECK_EQUAL(*small.lookup(5), std::string("e"));
+  BOOST_CHECK(small.lookup(0) == nullptr);
+  BOOST_CHECK(small.lookup(6) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
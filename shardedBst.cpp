@@ -0,0 +1,320 @@
+#include "shardedBst.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <future>
+
+// Writes between checks for skewed shards
+static const std::size_t rebalanceInterval = 1 << 16;
+
+// A shard holding more than this multiple of the average triggers a rebalance
+static const std::size_t skewFactor = 2;
+
+static bool skewed(const std::vector<std::size_t>& sizes) {
+  std::size_t total = 0;
+  for (std::size_t s : sizes) total += s;
+
+  std::size_t largest = *std::max_element(sizes.begin(), sizes.end());
+  return largest * sizes.size() > skewFactor * total && total >= rebalanceInterval;
+}
+
+struct ShardedBST::Request {
+  std::atomic<Request*> next{nullptr};
+  std::function<void(BST&)> run; // Empty for the request that stops the worker
+
+  explicit Request(std::function<void(BST&)> r) : run(std::move(r)) { }
+};
+
+// Lock-free multi-producer, single-consumer queue (Vyukov). Producers only
+// exchange the head; the worker alone follows next links from the tail.
+class ShardedBST::RequestQueue {
+  public:
+    RequestQueue() : _head(&_stub), _tail(&_stub), _stub(nullptr) { }
+
+    ~RequestQueue() {
+      while (Request* r = pop()) delete r;
+    }
+
+    void push(Request* r) {
+      r->next.store(nullptr, std::memory_order_relaxed);
+      Request* previous = _head.exchange(r, std::memory_order_acq_rel);
+      // Sequentially consistent so that a worker going to sleep sees the
+      // link, or its producer sees the worker's sleeping flag
+      previous->next.store(r, std::memory_order_seq_cst);
+    }
+
+    Request* pop() {
+      Request* tail = _tail;
+      Request* next = tail->next.load(std::memory_order_acquire);
+
+      if (tail == &_stub) {
+        if (next == nullptr) return nullptr;
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+      }
+
+      if (next != nullptr) {
+        _tail = next;
+        return tail;
+      }
+
+      // A producer has exchanged the head but not yet linked its request
+      if (tail != _head.load(std::memory_order_acquire)) return nullptr;
+
+      push(&_stub);
+      next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr) return nullptr;
+
+      _tail = next;
+      return tail;
+    }
+
+    // Only called by the consumer. A request still being linked counts as
+    // absent; its producer checks for a sleeping worker after linking it.
+    bool empty() const {
+      return _tail == &_stub && _stub.next.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+  private:
+    std::atomic<Request*> _head;
+    Request* _tail;
+    Request _stub;
+};
+
+struct ShardedBST::Shard {
+  BST dict;
+  RequestQueue queue;
+  std::thread worker;
+
+  // Entries after the last write, published for skew checks
+  std::atomic<std::size_t> entries{0};
+
+  // The worker sleeps here when its queue is empty
+  std::atomic<bool> sleeping{false};
+  std::mutex mutex;
+  std::condition_variable wakeup;
+};
+
+ShardedBST::ShardedBST(unsigned shards) {
+  shards = std::max(1u, shards);
+
+  // Start by splitting the whole key space evenly
+  const std::int64_t span = (std::int64_t(1) << 32) / shards;
+  for (unsigned i = 1; i < shards; ++i)
+    _boundaries.push_back(static_cast<keyType>(std::int64_t(INT_MIN) + i * span));
+
+  for (unsigned i = 0; i < shards; ++i)
+    _shards.emplace_back(new Shard());
+  for (auto& shard : _shards)
+    shard->worker = std::thread(&ShardedBST::work, this, std::ref(*shard));
+}
+
+ShardedBST::~ShardedBST() {
+  for (auto& shard : _shards)
+    submit(*shard, nullptr);
+  for (auto& shard : _shards)
+    shard->worker.join();
+}
+
+std::size_t ShardedBST::shardIndex(keyType k) const {
+  return static_cast<std::size_t>(
+    std::upper_bound(_boundaries.begin(), _boundaries.end(), k) - _boundaries.begin());
+}
+
+void ShardedBST::submit(Shard& shard, std::function<void(BST&)> run) {
+  shard.queue.push(new Request(std::move(run)));
+
+  if (shard.sleeping.load()) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.wakeup.notify_one();
+  }
+}
+
+void ShardedBST::work(Shard& shard) {
+  while (true) {
+    if (Request* r = shard.queue.pop()) {
+      bool stop = !r->run;
+      if (!stop) r->run(shard.dict);
+      delete r;
+      if (stop) return;
+      continue;
+    }
+
+    // Announce the sleep before the last look at the queue, so a producer
+    // either sees the flag or its request is seen here
+    shard.sleeping.store(true);
+    if (shard.queue.empty()) {
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      shard.wakeup.wait(lock, [&shard] { return !shard.queue.empty(); });
+    }
+    shard.sleeping.store(false);
+  }
+}
+
+void ShardedBST::insert(keyType k, itemType i) {
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(_boundariesMutex);
+    Shard& shard = *_shards[shardIndex(k)];
+    submit(shard, [k, i, &shard](BST& dict) {
+      dict.insert(k, i);
+      shard.entries.store(dict.cacheStats().entries, std::memory_order_relaxed);
+    });
+  }
+
+  if (++_writes % rebalanceInterval == 0) rebalanceIfSkewed();
+}
+
+void ShardedBST::remove(keyType k) {
+  std::shared_lock<std::shared_timed_mutex> lock(_boundariesMutex);
+  Shard& shard = *_shards[shardIndex(k)];
+  submit(shard, [k, &shard](BST& dict) {
+    dict.remove(k);
+    shard.entries.store(dict.cacheStats().entries, std::memory_order_relaxed);
+  });
+}
+
+std::unique_ptr<ShardedBST::itemType> ShardedBST::lookup(keyType k) {
+  return std::move(lookupBatch({k}).front());
+}
+
+// Sends each shard one request for all of its keys; every request fills
+// its own slots of the result
+std::vector<std::unique_ptr<ShardedBST::itemType>> ShardedBST::lookupBatch(const std::vector<keyType>& keys) {
+  std::vector<std::unique_ptr<itemType>> results(keys.size());
+  std::vector<std::future<void>> done;
+
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(_boundariesMutex);
+
+    std::vector<std::vector<std::size_t>> positions(_shards.size());
+    for (std::size_t p = 0; p < keys.size(); ++p)
+      positions[shardIndex(keys[p])].push_back(p);
+
+    for (std::size_t s = 0; s < _shards.size(); ++s) {
+      if (positions[s].empty()) continue;
+
+      auto finished = std::make_shared<std::promise<void>>();
+      done.push_back(finished->get_future());
+      std::vector<std::size_t> mine = std::move(positions[s]);
+
+      submit(*_shards[s], [&keys, &results, mine, finished](BST& dict) {
+        for (std::size_t p : mine) {
+          itemType* found = dict.lookup(keys[p]);
+          if (found != nullptr) results[p].reset(new itemType(*found));
+        }
+        finished->set_value();
+      });
+    }
+  }
+
+  for (auto& d : done) d.get();
+  return results;
+}
+
+// Shards cover consecutive key ranges, so concatenating their answers in
+// shard order keeps the whole result in key order
+std::vector<ShardedBST::entryType> ShardedBST::rangeScan(keyType low, keyType high) {
+  std::vector<entryType> result;
+  if (high < low) return result;
+
+  std::vector<std::vector<entryType>> parts;
+  std::vector<std::future<void>> done;
+
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(_boundariesMutex);
+
+    std::size_t first = shardIndex(low);
+    std::size_t last = shardIndex(high);
+    parts.resize(last - first + 1);
+
+    for (std::size_t s = first; s <= last; ++s) {
+      auto finished = std::make_shared<std::promise<void>>();
+      done.push_back(finished->get_future());
+      std::vector<entryType>* part = &parts[s - first];
+
+      submit(*_shards[s], [low, high, part, finished](BST& dict) {
+        dict.forEachInRange(low, high, [part](keyType k, const itemType& i) {
+          part->emplace_back(k, i);
+        });
+        finished->set_value();
+      });
+    }
+  }
+
+  for (auto& d : done) d.get();
+  for (auto& part : parts)
+    std::move(part.begin(), part.end(), std::back_inserter(result));
+  return result;
+}
+
+// Waits until every request made so far has run
+void ShardedBST::flush() {
+  std::vector<std::future<void>> done;
+
+  for (auto& shard : _shards) {
+    auto finished = std::make_shared<std::promise<void>>();
+    done.push_back(finished->get_future());
+    submit(*shard, [finished](BST&) { finished->set_value(); });
+  }
+
+  for (auto& d : done) d.get();
+}
+
+std::vector<std::size_t> ShardedBST::shardSizes() const {
+  std::vector<std::size_t> sizes;
+  for (auto& shard : _shards)
+    sizes.push_back(shard->entries.load(std::memory_order_relaxed));
+  return sizes;
+}
+
+// The published entry counts lag behind queued writes, but are close
+// enough to rule out a rebalance without stopping the writers. Only when
+// they show skew are the shards locked, flushed and compared exactly.
+void ShardedBST::rebalanceIfSkewed() {
+  if (!skewed(shardSizes())) return;
+
+  std::unique_lock<std::shared_timed_mutex> lock(_boundariesMutex);
+  flush();
+  if (skewed(shardSizes())) rebalanceLocked();
+}
+
+void ShardedBST::rebalance() {
+  std::unique_lock<std::shared_timed_mutex> lock(_boundariesMutex);
+  rebalanceLocked();
+}
+
+// Moves the boundaries to the quantiles of the current keys and carries
+// each entry that changes shard across as a node handle. Moved entries
+// arrive in key order, so every shard is compacted afterwards. No new request
+// can be queued while the boundaries are locked, so once the queues are
+// flushed the workers are idle and the shards can be used directly.
+void ShardedBST::rebalanceLocked() {
+  flush();
+
+  std::vector<keyType> keys;
+  for (auto& shard : _shards)
+    shard->dict.forEachInRange(INT_MIN, INT_MAX, [&keys](keyType k, const itemType&) {
+      keys.push_back(k);
+    });
+  if (keys.size() < _shards.size()) return;
+
+  std::vector<keyType> boundaries;
+  for (std::size_t s = 1; s < _shards.size(); ++s)
+    boundaries.push_back(keys[s * keys.size() / _shards.size()]);
+
+  for (keyType k : keys) {
+    std::size_t from = shardIndex(k);
+    std::size_t to = static_cast<std::size_t>(
+      std::upper_bound(boundaries.begin(), boundaries.end(), k) - boundaries.begin());
+    if (from != to)
+      _shards[to]->dict.insert(_shards[from]->dict.extract(k));
+  }
+
+  _boundaries = std::move(boundaries);
+  for (auto& shard : _shards) {
+    shard->dict.compact();
+    shard->entries.store(shard->dict.cacheStats().entries, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef SHARDED_BST_H
+#define SHARDED_BST_H
+
+#include "bst.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Dictionary split by key range across several BSTs, each owned by its own
+// worker thread. Writes are queued and return at once; requests to the same
+// shard run in the order they were made. Reads wait for their answers.
+// Shard boundaries move to even out the shards when they become skewed.
+class ShardedBST {
+  public:
+    using keyType = BST::keyType;
+    using itemType = BST::itemType;
+    using entryType = std::pair<keyType, itemType>;
+
+    explicit ShardedBST(unsigned shards);
+    ~ShardedBST();
+
+    ShardedBST(const ShardedBST&) = delete;
+    ShardedBST& operator = (const ShardedBST&) = delete;
+
+    void insert(keyType, itemType);
+    void remove(keyType);
+
+    // Copies of the items found, or nullptr, in the order of the keys given
+    std::unique_ptr<itemType> lookup(keyType);
+    std::vector<std::unique_ptr<itemType>> lookupBatch(const std::vector<keyType>&);
+
+    // Entries with keys in [low, high], in key order
+    std::vector<entryType> rangeScan(keyType low, keyType high);
+
+    void flush();
+    void rebalance();
+    std::vector<std::size_t> shardSizes() const;
+
+  private:
+    struct Request;
+    class RequestQueue;
+    struct Shard;
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    // Shard i holds keys below _boundaries[i] and at or above _boundaries[i - 1]
+    std::vector<keyType> _boundaries;
+    mutable std::shared_timed_mutex _boundariesMutex;
+
+    std::atomic<std::size_t> _writes{0};
+
+    std::size_t shardIndex(keyType) const;
+    void submit(Shard&, std::function<void(BST&)>);
+    void work(Shard&);
+    void rebalanceIfSkewed();
+    void rebalanceLocked();
+};
+
+#endif
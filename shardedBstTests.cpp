@@ -0,0 +1,270 @@
+#include "shardedBst.h"
+
+// NOTE: Required before the include below
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE sharded_bst_tests
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <numeric>
+#include <random>
+#include <thread>
+
+using Dict = ShardedBST;
+using keyType = Dict::keyType;
+using itemType = Dict::itemType;
+
+// Utility functions
+
+void isPresent(Dict& dict, keyType k, itemType i) {
+  std::unique_ptr<itemType> p_i = dict.lookup(k);
+
+  BOOST_CHECK_MESSAGE(p_i, std::to_string(k) + " is missing");
+
+  if (p_i) {
+    BOOST_CHECK_MESSAGE(*p_i == i,
+      std::to_string(k) + " should be " + i + ", but found " + *p_i);
+  }
+}
+
+void isAbsent(Dict& dict, keyType k) {
+  BOOST_CHECK_MESSAGE(dict.lookup(k) == nullptr,
+    std::to_string(k) + " should be absent, but is present");
+}
+
+void insertTestData(Dict& dict) {
+  dict.insert(9, "Edward");
+  dict.insert(22, "Jane");
+  dict.insert(22, "Mary");
+  dict.insert(0, "Harold");
+  dict.insert(37, "Victoria");
+  dict.insert(4, "Matilda");
+  dict.insert(26, "Oliver");
+  dict.insert(42, "Elizabeth");
+  dict.insert(19, "Henry");
+  dict.insert(4, "Stephen");
+  dict.insert(24, "James");
+  dict.insert(-1, "Edward");
+  dict.insert(31, "Anne");
+  dict.insert(23, "Elizabeth");
+  dict.insert(1, "William");
+  dict.insert(26, "Charles");
+}
+
+std::size_t total(const std::vector<std::size_t>& sizes) {
+  std::size_t sum = 0;
+  for (std::size_t s : sizes) sum += s;
+  return sum;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( lookup_insert_tests )
+
+BOOST_AUTO_TEST_CASE( empty_lookup ) {
+  Dict dict(4);
+  isAbsent(dict, 1);
+}
+
+BOOST_AUTO_TEST_CASE( lookup_sees_earlier_writes ) {
+  Dict dict(4);
+  insertTestData(dict);
+
+  isPresent(dict, 22, "Mary");
+  isPresent(dict, 4, "Stephen");
+  isPresent(dict, 26, "Charles");
+  isPresent(dict, -1, "Edward");
+  isAbsent(dict, 2);
+
+  dict.remove(22);
+  dict.remove(6);
+  isAbsent(dict, 22);
+  isPresent(dict, 23, "Elizabeth");
+}
+
+BOOST_AUTO_TEST_CASE( extreme_keys_route ) {
+  Dict dict(3);
+
+  dict.insert(INT_MIN, "min");
+  dict.insert(INT_MAX, "max");
+  dict.insert(0, "zero");
+
+  isPresent(dict, INT_MIN, "min");
+  isPresent(dict, INT_MAX, "max");
+  isPresent(dict, 0, "zero");
+
+  dict.flush();
+  BOOST_CHECK(dict.shardSizes() == std::vector<std::size_t>({1, 1, 1}));
+}
+
+BOOST_AUTO_TEST_CASE( single_shard ) {
+  Dict dict(0);
+  insertTestData(dict);
+
+  isPresent(dict, 42, "Elizabeth");
+  BOOST_CHECK_EQUAL(dict.shardSizes().size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( batch_keeps_key_order ) {
+  Dict dict(4);
+  insertTestData(dict);
+
+  std::vector<keyType> keys = {42, INT_MIN, -1, 22, 5, 22};
+  auto found = dict.lookupBatch(keys);
+
+  BOOST_REQUIRE_EQUAL(found.size(), keys.size());
+  BOOST_CHECK(found[0] && *found[0] == "Elizabeth");
+  BOOST_CHECK(!found[1]);
+  BOOST_CHECK(found[2] && *found[2] == "Edward");
+  BOOST_CHECK(found[3] && *found[3] == "Mary");
+  BOOST_CHECK(!found[4]);
+  BOOST_CHECK(found[5] && *found[5] == "Mary");
+}
+
+// Writers on several threads against std::map as a reference; each thread
+// owns its own keys so the final state does not depend on interleaving
+BOOST_AUTO_TEST_CASE( concurrent_writers ) {
+  Dict dict(4);
+  const int writers = 4;
+  std::vector<std::map<keyType, itemType>> expected(writers);
+  std::vector<std::thread> threads;
+
+  for (int w = 0; w < writers; ++w) {
+    threads.emplace_back([&dict, &expected, w] {
+      std::mt19937 rng(w);
+      std::uniform_int_distribution<keyType> key(INT_MIN / writers, INT_MAX / writers);
+
+      for (int step = 0; step < 5000; ++step) {
+        keyType k = key(rng) * writers + w;
+        if (rng() % 4 == 0) {
+          dict.remove(k);
+          expected[w].erase(k);
+        } else {
+          dict.insert(k, std::to_string(step));
+          expected[w][k] = std::to_string(step);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  std::size_t entries = 0;
+  for (auto& mine : expected) {
+    entries += mine.size();
+    for (auto& entry : mine)
+      isPresent(dict, entry.first, entry.second);
+  }
+
+  dict.flush();
+  BOOST_CHECK_EQUAL(total(dict.shardSizes()), entries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( range_scan_tests )
+
+BOOST_AUTO_TEST_CASE( scan_within_one_shard ) {
+  Dict dict(4);
+  insertTestData(dict);
+
+  auto found = dict.rangeScan(20, 30);
+
+  std::vector<Dict::entryType> expected = {
+    {22, "Mary"}, {23, "Elizabeth"}, {24, "James"}, {26, "Charles"}};
+  BOOST_CHECK(found == expected);
+}
+
+BOOST_AUTO_TEST_CASE( scan_across_shards_in_order ) {
+  Dict dict(8);
+  std::map<keyType, itemType> expected;
+  std::mt19937 rng(3);
+
+  for (int step = 0; step < 3000; ++step) {
+    keyType k = static_cast<keyType>(rng());
+    dict.insert(k, std::to_string(step));
+    expected[k] = std::to_string(step);
+  }
+
+  auto found = dict.rangeScan(INT_MIN, INT_MAX);
+  BOOST_CHECK(found == std::vector<Dict::entryType>(expected.begin(), expected.end()));
+
+  found = dict.rangeScan(-1000000000, 1000000000);
+  BOOST_CHECK(found == std::vector<Dict::entryType>(
+    expected.lower_bound(-1000000000), expected.upper_bound(1000000000)));
+}
+
+BOOST_AUTO_TEST_CASE( empty_range ) {
+  Dict dict(4);
+  insertTestData(dict);
+
+  BOOST_CHECK(dict.rangeScan(30, 20).empty());
+  BOOST_CHECK(dict.rangeScan(43, INT_MAX).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+//////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE( rebalance_tests )
+
+// Small keys all start in the same shard
+BOOST_AUTO_TEST_CASE( rebalance_evens_out_shards ) {
+  Dict dict(4);
+  for (keyType k = 0; k < 1000; ++k)
+    dict.insert(k, std::to_string(k));
+
+  dict.flush();
+  BOOST_CHECK(dict.shardSizes() == std::vector<std::size_t>({0, 0, 1000, 0}));
+
+  dict.rebalance();
+  BOOST_CHECK(dict.shardSizes() == std::vector<std::size_t>({250, 250, 250, 250}));
+
+  for (keyType k = 0; k < 1000; k += 37)
+    isPresent(dict, k, std::to_string(k));
+  BOOST_CHECK_EQUAL(dict.rangeScan(INT_MIN, INT_MAX).size(), 1000u);
+
+  dict.insert(1000, "1000");
+  dict.remove(0);
+  isPresent(dict, 1000, "1000");
+  isAbsent(dict, 0);
+}
+
+BOOST_AUTO_TEST_CASE( rebalance_with_few_entries ) {
+  Dict dict(4);
+  dict.insert(1, "one");
+
+  dict.rebalance();
+  isPresent(dict, 1, "one");
+
+  Dict empty(4);
+  empty.rebalance();
+  isAbsent(empty, 1);
+}
+
+// Enough skewed writes pass a skew check, which moves the boundaries. The
+// check reads the counts published by the workers, so flushing as the
+// writes go keeps those counts from lagging far behind.
+BOOST_AUTO_TEST_CASE( skew_triggers_rebalance ) {
+  Dict dict(4);
+  std::vector<keyType> keys(1 << 17);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(5));
+
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    if (i % 4096 == 0) dict.flush();
+    dict.insert(keys[i], "");
+  }
+
+  dict.flush();
+  std::vector<std::size_t> sizes = dict.shardSizes();
+  BOOST_CHECK_EQUAL(total(sizes), std::size_t(1) << 17);
+  BOOST_CHECK(*std::max_element(sizes.begin(), sizes.end()) < (std::size_t(1) << 17));
+  isPresent(dict, 12345, "");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+#ifndef STATIC_BST_H
+#define STATIC_BST_H
+
+#include "bst.h"
+
+#include <cstddef>
+
+struct StaticEntry {
+  BST::keyType key;
+  const char* item;
+};
+
+// Dictionary whose entries are fixed at compile time. Later entries
+// overwrite earlier ones with the same key, as with BST::insert.
+template <std::size_t N>
+class StaticBST {
+  public:
+    using keyType = BST::keyType;
+    using itemType = const char*;
+
+    constexpr StaticBST(const StaticEntry (&entries)[N]);
+
+    constexpr const itemType* lookup(keyType) const;
+    constexpr std::size_t size() const { return _size; }
+
+  private:
+    // Entries are kept in breadth-first (Eytzinger) order from slot 1,
+    // so the children of slot k are 2k and 2k + 1
+    keyType _keys[N + 1];
+    itemType _items[N + 1];
+    std::size_t _size;
+
+    constexpr std::size_t layoutRec(const StaticEntry*, std::size_t, std::size_t);
+};
+
+template <std::size_t N>
+constexpr StaticBST<N>::StaticBST(const StaticEntry (&entries)[N])
+  : _keys(), _items(), _size(0) {
+  StaticEntry sorted[N] = {};
+
+  // Stable insertion sort, so equal keys stay in insertion order
+  for (std::size_t i = 0; i < N; ++i) {
+    std::size_t j = i;
+    while (j > 0 && entries[i].key < sorted[j - 1].key) {
+      sorted[j] = sorted[j - 1];
+      --j;
+    }
+    sorted[j] = entries[i];
+  }
+
+  // Keep only the last entry of each run of equal keys
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i + 1 < N && sorted[i + 1].key == sorted[i].key) continue;
+    sorted[_size++] = sorted[i];
+  }
+
+  layoutRec(sorted, 0, 1);
+}
+
+// In-order walk of the implicit tree, filling slots from the sorted entries
+template <std::size_t N>
+constexpr std::size_t StaticBST<N>::layoutRec(const StaticEntry* sorted,
+                                              std::size_t next, std::size_t slot) {
+  if (slot > _size) return next;
+
+  next = layoutRec(sorted, next, 2 * slot);
+  _keys[slot] = sorted[next].key;
+  _items[slot] = sorted[next].item;
+  return layoutRec(sorted, next + 1, 2 * slot + 1);
+}
+
+template <std::size_t N>
+constexpr const typename StaticBST<N>::itemType* StaticBST<N>::lookup(keyType soughtKey) const {
+  // Each level picks a child arithmetically rather than by branching
+  std::size_t slot = 1;
+  while (slot <= _size)
+    slot = 2 * slot + (_keys[slot] < soughtKey);
+
+  // Undo the trailing right turns and the final left turn to reach the
+  // smallest key not less than soughtKey (slot 0 if there is none)
+  slot >>= __builtin_ctzll(~static_cast<unsigned long long>(slot)) + 1;
+
+  return (slot != 0 && _keys[slot] == soughtKey) ? &_items[slot] : nullptr;
+}
+
+template <std::size_t N>
+constexpr StaticBST<N> makeStaticBST(const StaticEntry (&entries)[N]) {
+  return StaticBST<N>(entries);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "stringPool.h"
+
+#include <utility>
+
+// Heap bytes a copy of s allocates; short strings are stored inline
+static std::ptrdiff_t heapBytes(const std::string& s) {
+  return s.size() > std::string().capacity() ? static_cast<std::ptrdiff_t>(s.size() + 1) : 0;
+}
+
+// What each reference saves by pointing at the pooled copy of s rather
+// than holding a copy of its own
+static std::ptrdiff_t referenceSaving(const std::string& s) {
+  return static_cast<std::ptrdiff_t>(sizeof(std::string) - sizeof(const std::string*)) + heapBytes(s);
+}
+
+// What the pool spends holding s: the copy in a hash map node, with its
+// link, cached hash and bucket slot
+static std::ptrdiff_t entryCost(const std::string& s) {
+  return static_cast<std::ptrdiff_t>(sizeof(std::pair<const std::string, std::size_t>)
+    + 3 * sizeof(void*)) + heapBytes(s);
+}
+
+const std::string* StringPool::acquire(const std::string& s) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto entry = _references.emplace(s, 0).first;
+  if (entry->second++ == 0) _bytesSaved -= entryCost(s);
+  _bytesSaved += referenceSaving(s);
+  return &(entry->first);
+}
+
+void StringPool::retain(const std::string* p) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  ++_references.find(*p)->second;
+  _bytesSaved += referenceSaving(*p);
+}
+
+void StringPool::release(const std::string* p) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto entry = _references.find(*p);
+  _bytesSaved -= referenceSaving(*p);
+  if (--entry->second > 0) return;
+
+  _bytesSaved += entryCost(*p);
+  _references.erase(entry);
+}
+
+// Number of distinct strings held
+std::size_t StringPool::size() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _references.size();
+}
+
+// Net bytes saved over every reference holding its own copy, less what the
+// pool itself takes. Negative while most strings are short or unique.
+std::ptrdiff_t StringPool::bytesSaved() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _bytesSaved;
+}
@@ -0,0 +1,32 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Reference-counted set of distinct strings. Equal strings acquired from
+// the pool share one copy, identified by a stable pointer to it. The pool
+// may be shared by several trees and used from several threads.
+class StringPool {
+  public:
+    StringPool() = default;
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator = (const StringPool&) = delete;
+
+    const std::string* acquire(const std::string&);
+    void retain(const std::string*);
+    void release(const std::string*);
+
+    std::size_t size() const;
+    std::ptrdiff_t bytesSaved() const;
+
+  private:
+    std::unordered_map<std::string, std::size_t> _references;
+    std::ptrdiff_t _bytesSaved = 0;
+    mutable std::mutex _mutex;
+};
+
+#endif